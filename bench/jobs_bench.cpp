@@ -0,0 +1,156 @@
+// Measures what the job system costs and what it buys: the overhead of
+// scheduling empty jobs, parallel_for against the plain serial loop it
+// replaces, and a fan-out/fan-in graph (leaf jobs joined by a run_after
+// continuation) against the same work done in series.
+#include "Jobs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double work(int i)
+{
+    return sqrt(i * 0.5) * sin(i * 0.001);
+}
+
+static void empty_job(void *, int, int)
+{
+}
+
+static void bench_overhead(int job_count)
+{
+    Jobs::Job job;
+    job.function = empty_job;
+    double start = now_ms();
+    Jobs::Counter counter;
+    for (int i = 0; i < job_count; ++i)
+    {
+        Jobs::run(job, &counter);
+    }
+    Jobs::wait(&counter);
+    double elapsed = now_ms() - start;
+    printf("overhead: %d empty jobs in %.3f ms (%.0f ns per job)\n", job_count, elapsed, elapsed * 1e6 / job_count);
+}
+
+static void bench_parallel_for(int length, int frames)
+{
+    std::vector<double> values(length);
+    double start = now_ms();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        for (int i = 0; i < length; ++i)
+        {
+            values[i] = work(i);
+        }
+    }
+    double serial_ms = (now_ms() - start) / frames;
+    printf("parallel_for over %d items: serial %.3f ms\n", length, serial_ms);
+    for (int grain : {256, 4096, 65536})
+    {
+        start = now_ms();
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            Jobs::parallel_for(0, length, grain, [&values](int begin, int end) {
+                for (int i = begin; i < end; ++i)
+                {
+                    values[i] = work(i);
+                }
+            });
+        }
+        double parallel_ms = (now_ms() - start) / frames;
+        printf("    grain %6d: %.3f ms (%.1fx)\n", grain, parallel_ms, serial_ms / parallel_ms);
+    }
+}
+
+struct FanOut
+{
+    std::vector<double> partials;
+    int leaf_size;
+    double total;
+};
+
+static void leaf_job(void *data, int begin, int end)
+{
+    FanOut *fan_out = static_cast<FanOut *>(data);
+    for (int leaf = begin; leaf < end; ++leaf)
+    {
+        double sum = 0;
+        for (int i = leaf * fan_out->leaf_size; i < (leaf + 1) * fan_out->leaf_size; ++i)
+        {
+            sum += work(i);
+        }
+        fan_out->partials[leaf] = sum;
+    }
+}
+
+static void join_job(void *data, int, int)
+{
+    FanOut *fan_out = static_cast<FanOut *>(data);
+    fan_out->total = 0;
+    for (double partial : fan_out->partials)
+    {
+        fan_out->total += partial;
+    }
+}
+
+static void bench_fan_out(int leaf_count, int leaf_size, int frames)
+{
+    FanOut fan_out;
+    fan_out.partials.resize(leaf_count);
+    fan_out.leaf_size = leaf_size;
+    double start = now_ms();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        leaf_job(&fan_out, 0, leaf_count);
+        join_job(&fan_out, 0, 1);
+    }
+    double serial_ms = (now_ms() - start) / frames;
+    double serial_total = fan_out.total;
+
+    start = now_ms();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        Jobs::Counter leaves;
+        Jobs::Counter joined;
+        Jobs::Job job;
+        job.function = leaf_job;
+        job.data = &fan_out;
+        for (int leaf = 0; leaf < leaf_count; ++leaf)
+        {
+            job.begin = leaf;
+            job.end = leaf + 1;
+            Jobs::run(job, &leaves);
+        }
+        Jobs::Job join;
+        join.function = join_job;
+        join.data = &fan_out;
+        Jobs::run_after(&leaves, join, &joined);
+        Jobs::wait(&joined);
+    }
+    double jobs_ms = (now_ms() - start) / frames;
+    printf("fan-out/fan-in, %d leaves of %d items: serial %.3f ms, jobs %.3f ms (%.1fx)%s\n",
+           leaf_count,
+           leaf_size,
+           serial_ms,
+           jobs_ms,
+           serial_ms / jobs_ms,
+           fan_out.total == serial_total ? "" : " MISMATCH");
+}
+
+// jobs_bench [worker_count], one worker per extra core by default.
+int main(int argc, char *argv[])
+{
+    Jobs::init(argc > 1 ? atoi(argv[1]) : -1);
+    bench_overhead(100000);
+    bench_parallel_for(1 << 22, 10);
+    bench_fan_out(64, 1 << 16, 10);
+    bench_fan_out(1024, 1 << 10, 10);
+    Jobs::shutdown();
+    return 0;
+}
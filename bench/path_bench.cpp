@@ -0,0 +1,148 @@
+// Times pathfinding on 256x256 and 1024x1024 maps of walled rooms joined by
+// doorways: building the walkable bits and regions, uncached find_path
+// searches, the same routes looked up again through the Manager's cache, a
+// frame's worth of FIND_PATH requests answered by update, and building and
+// repairing flow fields.
+#include "Path.h"
+#include "MessageBus.h"
+#include "Jobs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+const static int ROOM_SIZE = 20;
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool is_wall(int x, int y)
+{
+    int door = ROOM_SIZE / 2;
+    return (x % ROOM_SIZE == 0 && y % ROOM_SIZE != door) || (y % ROOM_SIZE == 0 && x % ROOM_SIZE != door);
+}
+
+static void build_map(ECS::Map *map, int size)
+{
+    map->dimensions = {size, size};
+    map->grid.resize({size, size});
+    for (int y = 0; y < size; ++y)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            map->grid.set_tile({x, y}, ECS::BASE_TILE_LAYER, 0);
+            if (is_wall(x, y))
+            {
+                map->grid.set_tile({x, y}, ECS::OBJECT_TILE_LAYER, 1);
+            }
+        }
+    }
+}
+
+static V2 random_cell(std::mt19937 *rng, int size)
+{
+    V2 cell;
+    do
+    {
+        cell = {static_cast<int>((*rng)() % size), static_cast<int>((*rng)() % size)};
+    } while (is_wall(cell.x, cell.y));
+    return cell;
+}
+
+static void run(int size, int route_count, int field_count)
+{
+    ECS::Map map;
+    build_map(&map, size);
+    std::mt19937 rng(1);
+    std::vector<V2> origins(route_count);
+    std::vector<V2> goals(route_count);
+    for (int i = 0; i < route_count; ++i)
+    {
+        origins[i] = random_cell(&rng, size);
+        goals[i] = random_cell(&rng, size);
+    }
+
+    Path::Manager manager;
+    double start = now_ms();
+    manager.refresh(&map);
+    double refresh_ms = now_ms() - start;
+
+    Path::Search search;
+    std::vector<V2> path;
+    long long total_length = 0;
+    start = now_ms();
+    for (int i = 0; i < route_count; ++i)
+    {
+        if (Path::find_path(&manager.walkable, origins[i], goals[i], &path, &search))
+        {
+            total_length += path.size();
+        }
+    }
+    double search_ms = (now_ms() - start) / route_count;
+
+    start = now_ms();
+    for (int i = 0; i < route_count; ++i)
+    {
+        manager.find_path(origins[i], goals[i], &path);
+    }
+    double miss_ms = (now_ms() - start) / route_count;
+    start = now_ms();
+    for (int i = 0; i < route_count; ++i)
+    {
+        manager.find_path(origins[i], goals[i], &path);
+    }
+    double hit_ms = (now_ms() - start) / route_count;
+
+    // Fresh routes so update has to search every one of them.
+    Path::Manager batch_manager;
+    batch_manager.refresh(&map);
+    for (int i = 0; i < route_count; ++i)
+    {
+        Path::request_path(random_cell(&rng, size), random_cell(&rng, size));
+    }
+    batch_manager.process_messages(&map);
+    MBus::clear_path_messages();
+    MBus::clear_path_replies();
+    start = now_ms();
+    batch_manager.update(&map, 0);
+    double batch_ms = now_ms() - start;
+    int replies = MBus::get_queue(MBus::QueueType::PATH_REPLY).length;
+
+    // Every field is a new goal room, so each get_flow_field is a full build.
+    start = now_ms();
+    for (int i = 0; i < field_count; ++i)
+    {
+        V2 room = random_cell(&rng, size);
+        room = {room.x / ROOM_SIZE * ROOM_SIZE + 1, room.y / ROOM_SIZE * ROOM_SIZE + 1};
+        manager.get_flow_field({room.x, room.y, ROOM_SIZE - 1, ROOM_SIZE - 1});
+    }
+    double field_ms = (now_ms() - start) / field_count;
+    // Closing one doorway makes refresh repair every cached field.
+    int door = ROOM_SIZE / 2;
+    start = now_ms();
+    map.grid.set_tile({size / 2 / ROOM_SIZE * ROOM_SIZE, size / 2 / ROOM_SIZE * ROOM_SIZE + door}, ECS::OBJECT_TILE_LAYER, 1);
+    manager.refresh(&map);
+    double repair_ms = now_ms() - start;
+
+    printf("%dx%d map, walkable bits and regions built in %.2f ms\n", size, size, refresh_ms);
+    printf("    find_path: %.3f ms per route (%d routes, %.0f cells on average)\n", search_ms, route_count, static_cast<double>(total_length) / route_count);
+    printf("    Manager::find_path: %.3f ms uncached, %.5f ms cached\n", miss_ms, hit_ms);
+    printf("    update answering %d FIND_PATH requests: %.2f ms (%d replies)\n", route_count, batch_ms, replies);
+    printf("    flow field: %.2f ms per build, %.2f ms to repair %d fields after closing a door\n",
+           field_ms,
+           repair_ms,
+           static_cast<int>(manager.flow_fields.size()));
+}
+
+// path_bench [worker_count], one worker per extra core by default.
+int main(int argc, char *argv[])
+{
+    Jobs::init(argc > 1 ? atoi(argv[1]) : -1);
+    run(256, 1000, 8);
+    run(1024, 200, 8);
+    Jobs::shutdown();
+    return 0;
+}
@@ -0,0 +1,288 @@
+// Compares the SpatialHash against the linear scan it replaced at 10k, 100k
+// and 1M entities scattered over a square world: culling a camera-sized rect,
+// radius and point queries, and whole render_storage frames while the camera
+// pans. Then checks the Grid's occupancy bitmap queries against a cell by cell
+// is_cell_free scan on a random map and times both.
+#include "Entity.h"
+#include "Physics.h"
+#include "Window.h"
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int linear_rect(ECS::Storage *storage, Rect area)
+{
+    int hits = 0;
+    storage->view<const ECS::PositionComponent, const ECS::RenderComponent>().each(
+        [&](const ECS::PositionComponent &position, const ECS::RenderComponent &render) {
+            Rect bounds = ECS::render_bounds(&position, &render);
+            if (Physics::check_collision(&area, &bounds))
+            {
+                ++hits;
+            }
+        });
+    return hits;
+}
+
+static int linear_radius(ECS::Storage *storage, V2 center, int radius)
+{
+    int hits = 0;
+    storage->view<const ECS::PositionComponent, const ECS::RenderComponent>().each(
+        [&](const ECS::PositionComponent &position, const ECS::RenderComponent &render) {
+            Rect bounds = ECS::render_bounds(&position, &render);
+            int dx = std::max(std::max(bounds.x - center.x, 0), center.x - (bounds.x + bounds.w));
+            int dy = std::max(std::max(bounds.y - center.y, 0), center.y - (bounds.y + bounds.h));
+            if (dx * dx + dy * dy <= radius * radius)
+            {
+                ++hits;
+            }
+        });
+    return hits;
+}
+
+static void run(int entity_count, int frames)
+{
+    ECS::Component render;
+    render.type = ECS::RENDER;
+    render.data.r = {{0, 0, 16, 16}, Render::WORLD_LAYER, 0, Atoms::EMPTY_ATOM, 2, 0, true};
+    ECS::Storage storage;
+    std::mt19937 rng(1);
+    // Keeps the density (and so the number of hits per query) about the
+    // same at every size.
+    int world_size = static_cast<int>(64 * sqrt(static_cast<double>(entity_count)));
+    for (int i = 0; i < entity_count; ++i)
+    {
+        ECS::Component position;
+        position.type = ECS::POSITION;
+        position.data.p.position = {static_cast<int>(rng() % world_size), static_cast<int>(rng() % world_size)};
+        ECS::Entity e;
+        e.add_component(&position);
+        e.add_component(&render);
+        storage.create_entity(e);
+    }
+
+    ECS::SpatialHash hash;
+    double start = now_ms();
+    hash.update(&storage);
+    double build_ms = now_ms() - start;
+
+    Rect camera = {world_size / 2, world_size / 2, 800, 640};
+    V2 center = {world_size / 2, world_size / 2};
+    int linear_hits = 0;
+    start = now_ms();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        linear_hits = linear_rect(&storage, camera);
+    }
+    double linear_rect_ms = (now_ms() - start) / frames;
+    std::vector<ECS::EntityHandle> results;
+    // The first query sizes the hash's per-slot marks; keep that out of the
+    // timings.
+    hash.query_rect(&storage, camera, &results);
+    start = now_ms();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        results.clear();
+        hash.query_rect(&storage, camera, &results);
+    }
+    double hash_rect_ms = (now_ms() - start) / frames;
+    int hash_hits = results.size();
+
+    int linear_radius_hits = 0;
+    start = now_ms();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        linear_radius_hits = linear_radius(&storage, center, 300);
+    }
+    double linear_radius_ms = (now_ms() - start) / frames;
+    start = now_ms();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        results.clear();
+        hash.query_radius(&storage, center, 300, &results);
+    }
+    double hash_radius_ms = (now_ms() - start) / frames;
+    int hash_radius_hits = results.size();
+
+    start = now_ms();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        results.clear();
+        hash.query_point(&storage, {center.x + frame, center.y}, &results);
+    }
+    double hash_point_ms = (now_ms() - start) / frames;
+
+    // A panning camera forces the scan to re-test everything every frame.
+    ECS::RenderCache scan_cache;
+    ECS::RenderCache hash_cache;
+    Window::set_camera(camera);
+    ECS::render_storage(&storage, &scan_cache);
+    ECS::render_storage(&storage, &hash_cache, &hash);
+    double scan_frame_ms = 0;
+    double hash_frame_ms = 0;
+    for (int frame = 1; frame <= frames; ++frame)
+    {
+        Window::set_camera({camera.x + frame * 8, camera.y, camera.w, camera.h});
+        start = now_ms();
+        ECS::render_storage(&storage, &scan_cache);
+        scan_frame_ms += now_ms() - start;
+        start = now_ms();
+        ECS::render_storage(&storage, &hash_cache, &hash);
+        hash_frame_ms += now_ms() - start;
+    }
+
+    printf("%8d entities, hash built in %.1f ms\n", entity_count, build_ms);
+    printf("    rect:   linear %8.3f ms, hash %7.3f ms (%d/%d hits)\n", linear_rect_ms, hash_rect_ms, linear_hits, hash_hits);
+    printf("    radius: linear %8.3f ms, hash %7.3f ms (%d/%d hits)\n", linear_radius_ms, hash_radius_ms, linear_radius_hits, hash_radius_hits);
+    printf("    point:  hash %7.4f ms\n", hash_point_ms);
+    printf("    panning render_storage frame: scan %8.3f ms, hash %7.3f ms\n", scan_frame_ms / frames, hash_frame_ms / frames);
+}
+
+static bool scan_is_area_free(const ECS::Grid &grid, Rect area)
+{
+    if (area.x < 0 || area.y < 0 || area.x + area.w > grid.dimensions.x || area.y + area.h > grid.dimensions.y)
+    {
+        return false;
+    }
+    for (int y = area.y; y < area.y + area.h; ++y)
+    {
+        for (int x = area.x; x < area.x + area.w; ++x)
+        {
+            if (!grid.is_cell_free({x, y}))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Counts and finds over the part of area that's on the map.
+static int scan_free_cells(const ECS::Grid &grid, Rect area, V2 *first_free)
+{
+    int count = 0;
+    for (int y = std::max(area.y, 0); y < std::min(area.y + area.h, grid.dimensions.y); ++y)
+    {
+        for (int x = std::max(area.x, 0); x < std::min(area.x + area.w, grid.dimensions.x); ++x)
+        {
+            if (grid.is_cell_free({x, y}))
+            {
+                if (count++ == 0)
+                {
+                    *first_free = {x, y};
+                }
+            }
+        }
+    }
+    return count;
+}
+
+static void run_grid_queries(int size, int queries)
+{
+    // Mostly tiled with a few entities, and a fully free block so some areas
+    // pass is_area_free.
+    ECS::Grid grid;
+    grid.resize({size, size});
+    std::mt19937 rng(2);
+    for (int y = 0; y < size; ++y)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            bool open_block = x >= 100 && x < 300 && y >= 100 && y < 300;
+            if (open_block || rng() % 10 != 0)
+            {
+                grid.set_tile({x, y}, ECS::BASE_TILE_LAYER, 0);
+            }
+            if (!open_block && rng() % 50 == 0)
+            {
+                grid.set_entity({x, y}, {x, 0});
+            }
+        }
+    }
+
+    std::vector<Rect> areas = {
+        // Crosses the boundary between the first and second 64-bit words.
+        {60, 5, 10, 4},
+        {120, 120, 70, 3},
+        // Partly off the map on each side.
+        {-5, 10, 20, 20},
+        {10, -5, 20, 20},
+        {size - 10, 10, 20, 20},
+        {10, size - 10, 20, 20},
+        // Zero-size.
+        {64, 64, 0, 0},
+        {64, 64, 0, 5},
+        {64, 64, 5, 0},
+    };
+    while (static_cast<int>(areas.size()) < queries)
+    {
+        int w = rng() % 200;
+        int h = rng() % 200;
+        areas.push_back({static_cast<int>(rng() % (size + 40)) - 20, static_cast<int>(rng() % (size + 40)) - 20, w, h});
+    }
+
+    int mismatches = 0;
+    int free_areas = 0;
+    for (const Rect &area : areas)
+    {
+        V2 scan_first = {-1, -1};
+        int scan_count = scan_free_cells(grid, area, &scan_first);
+        V2 first = {-1, -1};
+        bool found = grid.find_free_cell(area, &first);
+        bool free = grid.is_area_free(area);
+        free_areas += free;
+        if (free != scan_is_area_free(grid, area) || grid.count_free_cells(area) != scan_count ||
+            found != (scan_count > 0) || (found && (first.x != scan_first.x || first.y != scan_first.y)))
+        {
+            if (mismatches++ < 5)
+            {
+                printf("    MISMATCH at area {%d, %d, %d, %d}\n", area.x, area.y, area.w, area.h);
+            }
+        }
+    }
+
+    double start = now_ms();
+    int scan_total = 0;
+    for (const Rect &area : areas)
+    {
+        V2 first;
+        scan_total += scan_is_area_free(grid, area) + scan_free_cells(grid, area, &first);
+    }
+    double scan_ms = (now_ms() - start) / areas.size();
+    start = now_ms();
+    int bitmap_total = 0;
+    for (const Rect &area : areas)
+    {
+        V2 first;
+        bitmap_total += grid.is_area_free(area) + grid.count_free_cells(area);
+        grid.find_free_cell(area, &first);
+    }
+    double bitmap_ms = (now_ms() - start) / areas.size();
+
+    printf("%dx%d grid, %d areas (%d fully free): %d mismatches against is_cell_free\n",
+           size,
+           size,
+           static_cast<int>(areas.size()),
+           free_areas,
+           mismatches);
+    printf("    is_area_free + count_free_cells (+ find_free_cell): scan %.4f ms, bitmaps %.4f ms per area%s\n",
+           scan_ms,
+           bitmap_ms,
+           scan_total == bitmap_total ? "" : " MISMATCH");
+}
+
+int main(int argc, char *argv[])
+{
+    run(10000, 50);
+    run(100000, 20);
+    run(1000000, 5);
+    run_grid_queries(1000, 2000);
+    return 0;
+}
@@ -0,0 +1,192 @@
+// Iterates 100k+ entities the way render_system does (cull every renderable
+// entity against the camera) and the way a movement system would (write every
+// position), once with the old per-entity layout and once with archetype
+// storage.
+#include "Entity.h"
+#include "Physics.h"
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// The layout ECS::Manager used before archetype storage: every entity owns a
+// heap array of fat components, each with its own strings vector, and
+// components are found by scanning that array.
+struct OldComponent
+{
+    ECS::Type type;
+    std::vector<std::string> strings;
+    union {
+        ECS::PositionComponent p;
+        ECS::RenderComponent r;
+        ECS::InfoComponent i;
+    } data;
+};
+
+struct OldEntity
+{
+    OldComponent *get_component(ECS::Type type)
+    {
+        for (int i = 0; i < this->component_length; ++i)
+        {
+            if (this->components[i].type == type)
+            {
+                return &this->components[i];
+            }
+        }
+        return nullptr;
+    }
+    OldComponent *components;
+    int component_flags;
+    int component_length;
+};
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int old_cull(std::vector<OldEntity> &entities, const Rect &camera)
+{
+    int visible = 0;
+    for (OldEntity &e : entities)
+    {
+        if ((e.component_flags & ECS::RENDER_SYSTEM_FLAGS) != ECS::RENDER_SYSTEM_FLAGS)
+        {
+            continue;
+        }
+        ECS::RenderComponent render = e.get_component(ECS::RENDER)->data.r;
+        ECS::PositionComponent position = e.get_component(ECS::POSITION)->data.p;
+        Rect entity_rect = {position.position.x, position.position.y, render.clip.w * render.scale, render.clip.h * render.scale};
+        Rect camera_rect = camera;
+        if (Physics::check_collision(&camera_rect, &entity_rect))
+        {
+            ++visible;
+        }
+    }
+    return visible;
+}
+
+static void old_move(std::vector<OldEntity> &entities)
+{
+    for (OldEntity &e : entities)
+    {
+        OldComponent *position = e.get_component(ECS::POSITION);
+        if (position != nullptr)
+        {
+            position->data.p.position.x += 1;
+        }
+    }
+}
+
+static int archetype_cull(ECS::Storage *storage, const Rect &camera)
+{
+    int visible = 0;
+    storage->view<const ECS::PositionComponent, const ECS::RenderComponent>().each(
+        [&](const ECS::PositionComponent &position, const ECS::RenderComponent &render) {
+            Rect entity_rect = ECS::render_bounds(&position, &render);
+            Rect camera_rect = camera;
+            if (Physics::check_collision(&camera_rect, &entity_rect))
+            {
+                ++visible;
+            }
+        });
+    return visible;
+}
+
+static void archetype_move(ECS::Storage *storage)
+{
+    storage->view<ECS::PositionComponent>().each([](ECS::PositionComponent &position) {
+        position.position.x += 1;
+    });
+}
+
+static void run(int entity_count, int frames)
+{
+    ECS::Component render;
+    render.type = ECS::RENDER;
+    render.data.r = {{0, 0, 16, 16}, Render::WORLD_LAYER, 0, Atoms::intern("tilesheet-demo"), 2, 0, true};
+    ECS::Component info;
+    info.type = ECS::INFO;
+    info.data.i = {Atoms::intern("Grass"), Atoms::intern("Just some green grass")};
+
+    std::vector<OldEntity> old_entities;
+    ECS::Storage storage;
+    for (int i = 0; i < entity_count; ++i)
+    {
+        ECS::Component position;
+        position.type = ECS::POSITION;
+        position.data.p.position = {(i % 1000) * 32, (i / 1000) * 32};
+        ECS::Entity e;
+        e.add_component(&render);
+        e.add_component(&info);
+        e.add_component(&position);
+        storage.create_entity(e);
+
+        OldEntity old;
+        old.components = new OldComponent[ECS::NUM_COMPONENT_TYPES];
+        old.component_flags = e.component_flags;
+        old.component_length = 3;
+        old.components[0].type = ECS::RENDER;
+        old.components[0].strings = {"tilesheet-demo"};
+        old.components[0].data.r = render.data.r;
+        old.components[1].type = ECS::INFO;
+        old.components[1].strings = {"Grass", "Just some green grass"};
+        old.components[1].data.i = info.data.i;
+        old.components[2].type = ECS::POSITION;
+        old.components[2].data.p = position.data.p;
+        old_entities.push_back(old);
+    }
+
+    Rect camera = {0, 0, 800, 640};
+    int old_visible = old_cull(old_entities, camera);
+    int archetype_visible = archetype_cull(&storage, camera);
+    double start = now_ms();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        old_visible = old_cull(old_entities, camera);
+    }
+    double old_cull_ms = (now_ms() - start) / frames;
+    start = now_ms();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        archetype_visible = archetype_cull(&storage, camera);
+    }
+    double archetype_cull_ms = (now_ms() - start) / frames;
+    start = now_ms();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        old_move(old_entities);
+    }
+    double old_move_ms = (now_ms() - start) / frames;
+    start = now_ms();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        archetype_move(&storage);
+    }
+    double archetype_move_ms = (now_ms() - start) / frames;
+
+    printf("%8d entities | cull: old %7.3f ms, archetype %7.3f ms (%.1fx, %d/%d visible) | move: old %7.3f ms, archetype %7.3f ms (%.1fx)\n",
+           entity_count,
+           old_cull_ms,
+           archetype_cull_ms,
+           old_cull_ms / archetype_cull_ms,
+           old_visible,
+           archetype_visible,
+           old_move_ms,
+           archetype_move_ms,
+           old_move_ms / archetype_move_ms);
+
+    for (OldEntity &old : old_entities)
+    {
+        delete[] old.components;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    run(100000, 20);
+    run(250000, 10);
+    run(1000000, 5);
+    return 0;
+}
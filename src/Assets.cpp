@@ -1,16 +1,195 @@
 #include "Assets.h"
+#include "Atlas.h"
 #include <sstream>
 #include <fstream>
 #include <stdio.h>
 #include <unordered_map>
 #include <assert.h>
+#include <algorithm>
 #include "json/picojson.h"
 
 static std::unordered_map<std::string, int> texture_index_map;
 static std::unordered_map<std::string, int> font_index_map;
 static std::vector<std::unique_ptr<Texture>> texture_table;
 static std::vector<Font *> font_table;
-std::unique_ptr<Texture> create_texture_from_file(std::string path, SDL_Renderer *renderer, int index);
+static std::vector<std::unique_ptr<Atlas::Page>> atlas_pages;
+// Generated textures get this much extra width so they can usually be redrawn
+// in place when their text changes.
+static const int GENERATED_REGION_ALIGNMENT = 16;
+
+struct PendingSprite
+{
+    std::string path;
+    int index;
+    SDL_Surface *image;
+};
+
+static SDL_Surface *load_image(std::string path)
+{
+    SDL_Surface *loaded_surface = IMG_Load(path.c_str());
+    if (loaded_surface == nullptr)
+    {
+        printf("Unable to load asset %s. SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+        return nullptr;
+    }
+    SDL_Surface *image = SDL_ConvertSurfaceFormat(loaded_surface, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(loaded_surface);
+    if (image == nullptr)
+    {
+        printf("Unable to convert asset %s. SDL Error: %s\n", path.c_str(), SDL_GetError());
+    }
+    return image;
+}
+
+// Packs every sprite sheet that fits into static atlas pages, tallest first.
+// Anything too big for a page gets a texture of its own.
+static void pack_sprites(SDL_Renderer *renderer, std::vector<PendingSprite> &sprites)
+{
+    for (PendingSprite &sprite : sprites)
+    {
+        sprite.image = load_image(sprite.path);
+    }
+    std::sort(sprites.begin(), sprites.end(), [](const PendingSprite &a, const PendingSprite &b) {
+        return (a.image == nullptr ? 0 : a.image->h) > (b.image == nullptr ? 0 : b.image->h);
+    });
+    V2 page_dimensions = Atlas::page_dimensions(renderer, Atlas::PAGE_SIZE);
+    int first_page = atlas_pages.size();
+    for (PendingSprite &sprite : sprites)
+    {
+        if (sprite.image == nullptr)
+        {
+            continue;
+        }
+        V2 dimensions = {sprite.image->w, sprite.image->h};
+        Rect region;
+        int page_index = -1;
+        for (int i = first_page; i < static_cast<int>(atlas_pages.size()) && page_index == -1; ++i)
+        {
+            if (atlas_pages[i]->packer.insert(dimensions, &region))
+            {
+                page_index = i;
+            }
+        }
+        if (page_index == -1 && dimensions.x <= page_dimensions.x && dimensions.y <= page_dimensions.y &&
+            static_cast<int>(atlas_pages.size()) < Atlas::MAX_PAGES)
+        {
+            std::unique_ptr<Atlas::Page> page(new Atlas::Page(renderer, page_dimensions, false));
+            if (page->texture != nullptr && page->packer.insert(dimensions, &region))
+            {
+                page_index = atlas_pages.size();
+                atlas_pages.push_back(std::move(page));
+            }
+        }
+        if (page_index == -1)
+        {
+            SDL_Texture *new_texture = SDL_CreateTextureFromSurface(renderer, sprite.image);
+            if (new_texture == nullptr)
+            {
+                printf("Unable to create texture from %s. SDL Error: %s\n", sprite.path.c_str(), SDL_GetError());
+            }
+            else
+            {
+                texture_table[sprite.index] = std::unique_ptr<Texture>(new Texture(new_texture, dimensions, sprite.index));
+            }
+        }
+        else
+        {
+            Atlas::Page *page = atlas_pages[page_index].get();
+            page->write(sprite.image, region);
+            texture_table[sprite.index] = std::unique_ptr<Texture>(
+                new Texture(page->texture, page->dimensions, region, dimensions, page_index, sprite.index));
+        }
+        SDL_FreeSurface(sprite.image);
+    }
+}
+
+// Finds room on a dynamic page, repacking pages or adding a new one if they
+// are full. replaced_index's current region is left out of any repack since
+// it's about to be dropped. Returns the page or -1.
+static int place_generated_texture(SDL_Renderer *renderer, V2 dimensions, int replaced_index, Rect *region)
+{
+    for (int i = 0; i < static_cast<int>(atlas_pages.size()); ++i)
+    {
+        if (atlas_pages[i]->dynamic && atlas_pages[i]->packer.insert(dimensions, region))
+        {
+            return i;
+        }
+    }
+    for (int i = 0; i < static_cast<int>(atlas_pages.size()); ++i)
+    {
+        if (!atlas_pages[i]->dynamic)
+        {
+            continue;
+        }
+        std::vector<Rect *> live_regions;
+        for (auto &texture : texture_table)
+        {
+            if (texture != nullptr && texture->page == i && texture->index != replaced_index)
+            {
+                live_regions.push_back(&texture->region);
+            }
+        }
+        if (atlas_pages[i]->compact(live_regions) && atlas_pages[i]->packer.insert(dimensions, region))
+        {
+            return i;
+        }
+    }
+    V2 page_dimensions = Atlas::page_dimensions(renderer, Atlas::DYNAMIC_PAGE_SIZE);
+    if (static_cast<int>(atlas_pages.size()) >= Atlas::MAX_PAGES || dimensions.x > page_dimensions.x || dimensions.y > page_dimensions.y)
+    {
+        return -1;
+    }
+    std::unique_ptr<Atlas::Page> page(new Atlas::Page(renderer, page_dimensions, true));
+    if (page->texture == nullptr || !page->packer.insert(dimensions, region))
+    {
+        return -1;
+    }
+    atlas_pages.push_back(std::move(page));
+    return atlas_pages.size() - 1;
+}
+
+// Puts a generated image on a dynamic atlas page, in place if the texture
+// already has room there. Returns false if it has to be a texture of its own.
+static bool atlas_generated_texture(SDL_Renderer *renderer, SDL_Surface *surface, int texture_index)
+{
+    V2 page_dimensions = Atlas::page_dimensions(renderer, Atlas::DYNAMIC_PAGE_SIZE);
+    // Big images would crowd out everything else.
+    if (surface->w > page_dimensions.x / 2 || surface->h > page_dimensions.y / 8)
+    {
+        return false;
+    }
+    SDL_Surface *image = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+    if (image == nullptr)
+    {
+        return false;
+    }
+    V2 dimensions = {image->w, image->h};
+    Texture *texture = texture_table[texture_index].get();
+    if (texture != nullptr && texture->page != -1 && atlas_pages[texture->page]->dynamic &&
+        texture->region.w >= dimensions.x && texture->region.h >= dimensions.y)
+    {
+        atlas_pages[texture->page]->write(image, texture->region);
+        texture->dimensions = dimensions;
+        SDL_FreeSurface(image);
+        return true;
+    }
+    V2 reserved = {
+        (dimensions.x + GENERATED_REGION_ALIGNMENT - 1) / GENERATED_REGION_ALIGNMENT * GENERATED_REGION_ALIGNMENT,
+        dimensions.y};
+    Rect region;
+    int page_index = place_generated_texture(renderer, reserved, texture_index, &region);
+    if (page_index == -1)
+    {
+        SDL_FreeSurface(image);
+        return false;
+    }
+    Atlas::Page *page = atlas_pages[page_index].get();
+    page->write(image, region);
+    texture_table[texture_index] = std::unique_ptr<Texture>(
+        new Texture(page->texture, page->dimensions, region, dimensions, page_index, texture_index));
+    SDL_FreeSurface(image);
+    return true;
+}
 
 void Assets::load_assets_from_manifest(SDL_Renderer *renderer, std::string path)
 {
@@ -32,6 +211,8 @@ void Assets::load_assets_from_manifest(SDL_Renderer *renderer, std::string path)
         return;
     }
     picojson::value::array &array = v.get<picojson::array>();
+    std::vector<PendingSprite> sprites;
+    std::unordered_map<std::string, int> sprite_paths;
     for (picojson::value::array::const_iterator array_it = array.begin(); array_it != array.end(); ++array_it)
     {
         if (array_it->is<picojson::object>())
@@ -63,10 +244,18 @@ void Assets::load_assets_from_manifest(SDL_Renderer *renderer, std::string path)
             }
             if (record.type == "sprite")
             {
+                // Keys for the same file share one texture.
+                auto existing = sprite_paths.find(record.path);
+                if (existing != sprite_paths.end())
+                {
+                    texture_index_map[record.texture_key] = existing->second;
+                    continue;
+                }
                 int index = texture_table.size();
-                std::unique_ptr<Texture> texture = create_texture_from_file(record.path, renderer, index);
                 texture_index_map[record.texture_key] = index;
-                texture_table.push_back(std::move(texture));
+                sprite_paths[record.path] = index;
+                texture_table.push_back(nullptr);
+                sprites.push_back({record.path, index, nullptr});
             }
             else if (record.type == "font")
             {
@@ -92,6 +281,7 @@ void Assets::load_assets_from_manifest(SDL_Renderer *renderer, std::string path)
             printf("JSON Err: asset-manifest.json should be an array of objects\n");
         }
     }
+    pack_sprites(renderer, sprites);
 }
 
 TextTextureInfo Assets::create_texture_from_text(SDL_Renderer *renderer, int font_index, std::string texture_key, std::string text, const Color &color)
@@ -108,30 +298,46 @@ TextTextureInfo Assets::create_texture_from_text(SDL_Renderer *renderer, int fon
         printf("Unable to render text surface! SDL_ttf Error: %s\n", IMG_GetError());
         return {-1};
     }
+    TextTextureInfo info = Assets::create_texture_from_surface(renderer, texture_key, text_surface);
+    SDL_FreeSurface(text_surface);
+    return info;
+}
 
-    SDL_Texture *new_texture = SDL_CreateTextureFromSurface(renderer, text_surface);
-    if (new_texture == nullptr)
+TextTextureInfo Assets::create_texture_from_surface(SDL_Renderer *renderer, std::string texture_key, SDL_Surface *surface)
+{
+    // A new key is expected here, so look it up quietly.
+    int texture_index;
+    auto existing = texture_index_map.find(texture_key);
+    bool new_key = existing == texture_index_map.end();
+    if (!new_key)
     {
-        printf("Unable to create texture from rendered text! SDL Error: %s\n", SDL_GetError());
-        return {-1};
+        texture_index = existing->second;
     }
-    int texture_index = -1;
-    int existing_texture_index = get_texture_index(texture_key);
-    Texture *texture = nullptr;
-    if (existing_texture_index == -1)
+    else
     {
         texture_index = texture_table.size();
-        texture = new Texture(new_texture, {text_surface->w, text_surface->h}, texture_index);
-        texture_table.push_back(std::unique_ptr<Texture>(texture));
+        texture_table.push_back(nullptr);
         texture_index_map[texture_key] = texture_index;
     }
-    else
+    if (atlas_generated_texture(renderer, surface, texture_index))
     {
-        texture_index = existing_texture_index;
-        texture = new Texture(new_texture, {text_surface->w, text_surface->h}, texture_index);
-        texture_table[texture_index] = std::unique_ptr<Texture>(texture);
+        return {texture_index, texture_table[texture_index]->dimensions};
     }
-    SDL_FreeSurface(text_surface);
+    SDL_Texture *new_texture = SDL_CreateTextureFromSurface(renderer, surface);
+    if (new_texture == nullptr)
+    {
+        printf("Unable to create texture from surface! SDL Error: %s\n", SDL_GetError());
+        // Don't leave the key pointing at an empty slot. An existing key
+        // keeps its old texture.
+        if (new_key)
+        {
+            texture_table.pop_back();
+            texture_index_map.erase(texture_key);
+        }
+        return {-1};
+    }
+    Texture *texture = new Texture(new_texture, {surface->w, surface->h}, texture_index);
+    texture_table[texture_index] = std::unique_ptr<Texture>(texture);
     return {texture_index, texture->dimensions};
 }
 
@@ -157,25 +363,13 @@ V2 Assets::get_texture_dimensions(std::string texture_key)
     return {0, 0};
 }
 
-std::unique_ptr<Texture> create_texture_from_file(std::string path, SDL_Renderer *renderer, int index)
+Font *Assets::get_font(int font_index)
 {
-    SDL_Surface *loaded_surface = IMG_Load(path.c_str());
-    if (loaded_surface == nullptr)
-    {
-        printf("Unable to load asset %s. SDL_image Error: %s\n", path.c_str(), IMG_GetError());
-        return nullptr;
-    }
-
-    SDL_Texture *new_texture = SDL_CreateTextureFromSurface(renderer, loaded_surface);
-    if (new_texture == nullptr)
+    if (font_index < 0 || font_index >= static_cast<int>(font_table.size()))
     {
-        printf("Unable to create texture from %s. SDL Error: %s\n", path.c_str(), SDL_GetError());
         return nullptr;
     }
-
-    Texture *texture = new Texture(new_texture, {loaded_surface->w, loaded_surface->h}, index);
-    SDL_FreeSurface(loaded_surface);
-    return std::unique_ptr<Texture>(texture);
+    return font_table[font_index];
 }
 
 std::vector<std::unique_ptr<Texture>> *Assets::get_texture_table()
@@ -221,11 +415,15 @@ void BlankTexture::render(SDL_Renderer *renderer, const V2 &position, double sca
 
 // Texture
 
-Texture::Texture(SDL_Texture *texture, const V2 &dimensions, int index) : texture(texture), dimensions(dimensions), index(index) {}
+Texture::Texture(SDL_Texture *texture, const V2 &dimensions, int index)
+    : texture(texture), dimensions(dimensions), index(index), region({0, 0, dimensions.x, dimensions.y}), texture_dimensions(dimensions), page(-1) {}
+
+Texture::Texture(SDL_Texture *page_texture, const V2 &page_dimensions, const Rect &region, const V2 &dimensions, int page, int index)
+    : texture(page_texture), dimensions(dimensions), index(index), region(region), texture_dimensions(page_dimensions), page(page) {}
 
 Texture::~Texture()
 {
-    if (this->texture != nullptr)
+    if (this->texture != nullptr && this->page == -1)
     {
         SDL_DestroyTexture(this->texture);
         this->texture = nullptr;
@@ -240,10 +438,12 @@ void Texture::render(SDL_Renderer *renderer, const V2 &position, SDL_Rect *clip,
         return;
     }
     SDL_Rect render_quad = {position.x, position.y, this->dimensions.x * static_cast<int>(scale), this->dimensions.y * static_cast<int>(scale)};
+    SDL_Rect source = {this->region.x, this->region.y, this->dimensions.x, this->dimensions.y};
     if (clip != NULL)
     {
         render_quad.w = clip->w * scale;
         render_quad.h = clip->h * scale;
+        source = {this->region.x + clip->x, this->region.y + clip->y, clip->w, clip->h};
     }
-    SDL_RenderCopyEx(renderer, this->texture, clip, &render_quad, angle, center, flip);
+    SDL_RenderCopyEx(renderer, this->texture, &source, &render_quad, angle, center, flip);
 }
\ No newline at end of file
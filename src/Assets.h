@@ -18,11 +18,21 @@ struct AssetManifestRecord
 struct Texture
 {
     Texture(SDL_Texture *, const V2 &dimensions, int index);
+    // An image inside an atlas page. The page owns the SDL texture.
+    Texture(SDL_Texture *page_texture, const V2 &page_dimensions, const Rect &region, const V2 &dimensions, int page, int index);
     ~Texture();
+    // clip is relative to the image, wherever it sits in the atlas.
     void render(SDL_Renderer *renderer, const V2 &position, SDL_Rect *clip = NULL, int scale = 1, double angle = 0.0, SDL_Point *center = NULL, SDL_RendererFlip flip = SDL_FLIP_NONE);
     SDL_Texture *texture;
     V2 dimensions;
     int index;
+    // Space reserved for the image in texture, starting at its top left
+    // corner. Can be bigger than dimensions so a generated texture can be
+    // redrawn in place.
+    Rect region;
+    V2 texture_dimensions;
+    // Atlas page, or -1 if the image has texture to itself.
+    int page;
 };
 
 struct BlankTexture
@@ -44,7 +54,12 @@ namespace Assets
 {
 void load_assets_from_manifest(SDL_Renderer *, std::string);
 TextTextureInfo create_texture_from_text(SDL_Renderer *renderer, int font_index, std::string texture_key, std::string text, const Color &color);
+// Uploads a copy of surface under texture_key. Calling it again with the same
+// key redraws that texture, in place when the new image fits.
+TextTextureInfo create_texture_from_surface(SDL_Renderer *renderer, std::string texture_key, SDL_Surface *surface);
 int get_texture_index(std::string texture_key);
+// nullptr for a bad font_index.
+Font *get_font(int font_index);
 std::vector<std::unique_ptr<Texture>> *get_texture_table();
 V2 get_texture_dimensions(std::string texture_key);
 } // namespace Assets
@@ -0,0 +1,229 @@
+#include "Atlas.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+
+Atlas::Packer::Packer() : dimensions({0, 0}){};
+
+void Atlas::Packer::reset(V2 dimensions)
+{
+    this->dimensions = dimensions;
+    this->skyline.assign(1, {0, 0, dimensions.x});
+}
+
+bool Atlas::Packer::insert(V2 size, Rect *placement)
+{
+    if (size.x <= 0 || size.y <= 0 || size.x > this->dimensions.x || size.y > this->dimensions.y)
+    {
+        return false;
+    }
+    int best_index = -1;
+    int best_top = INT32_MAX;
+    int best_width = INT32_MAX;
+    int best_y = 0;
+    int span_count = this->skyline.size();
+    for (int i = 0; i < span_count; ++i)
+    {
+        int x = this->skyline[i].x;
+        if (x + size.x > this->dimensions.x)
+        {
+            break;
+        }
+        // Rests on the highest span it covers.
+        int width = std::min(size.x + Atlas::PADDING, this->dimensions.x - x);
+        int y = 0;
+        for (int j = i; j < span_count && this->skyline[j].x < x + width; ++j)
+        {
+            y = std::max(y, this->skyline[j].y);
+        }
+        if (y + size.y > this->dimensions.y)
+        {
+            continue;
+        }
+        if (y + size.y < best_top || (y + size.y == best_top && this->skyline[i].w < best_width))
+        {
+            best_index = i;
+            best_top = y + size.y;
+            best_width = this->skyline[i].w;
+            best_y = y;
+        }
+    }
+    if (best_index == -1)
+    {
+        return false;
+    }
+    int x = this->skyline[best_index].x;
+    int width = std::min(size.x + Atlas::PADDING, this->dimensions.x - x);
+    this->skyline.insert(this->skyline.begin() + best_index, {x, best_y + size.y + Atlas::PADDING, width});
+    // Trim the spans the new one now covers.
+    int i = best_index + 1;
+    while (i < static_cast<int>(this->skyline.size()) && this->skyline[i].x < x + width)
+    {
+        int covered = x + width - this->skyline[i].x;
+        if (covered >= this->skyline[i].w)
+        {
+            this->skyline.erase(this->skyline.begin() + i);
+        }
+        else
+        {
+            this->skyline[i].x += covered;
+            this->skyline[i].w -= covered;
+            break;
+        }
+    }
+    for (i = 0; i + 1 < static_cast<int>(this->skyline.size());)
+    {
+        if (this->skyline[i].y == this->skyline[i + 1].y)
+        {
+            this->skyline[i].w += this->skyline[i + 1].w;
+            this->skyline.erase(this->skyline.begin() + i + 1);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    *placement = {x, best_y, size.x, size.y};
+    return true;
+}
+
+Atlas::Page::Page(SDL_Renderer *renderer, const V2 &dimensions, bool dynamic) : pixels(nullptr), dimensions({0, 0}), dynamic(dynamic)
+{
+    this->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, dimensions.x, dimensions.y);
+    if (this->texture == nullptr)
+    {
+        printf("Unable to create atlas page! SDL Error: %s\n", SDL_GetError());
+        return;
+    }
+    SDL_SetTextureBlendMode(this->texture, SDL_BLENDMODE_BLEND);
+    // Static pages start out with garbage, so clear them once. Dynamic pages
+    // upload from their zeroed pixel copy.
+    SDL_Surface *blank = SDL_CreateRGBSurfaceWithFormat(0, dimensions.x, dimensions.y, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (blank == nullptr)
+    {
+        printf("Unable to create atlas page pixels! SDL Error: %s\n", SDL_GetError());
+        SDL_DestroyTexture(this->texture);
+        this->texture = nullptr;
+        return;
+    }
+    SDL_UpdateTexture(this->texture, nullptr, blank->pixels, blank->pitch);
+    if (dynamic)
+    {
+        this->pixels = blank;
+    }
+    else
+    {
+        SDL_FreeSurface(blank);
+    }
+    this->dimensions = dimensions;
+    this->packer.reset(dimensions);
+}
+
+Atlas::Page::~Page()
+{
+    if (this->texture != nullptr)
+    {
+        SDL_DestroyTexture(this->texture);
+        this->texture = nullptr;
+    }
+    if (this->pixels != nullptr)
+    {
+        SDL_FreeSurface(this->pixels);
+        this->pixels = nullptr;
+    }
+}
+
+void Atlas::Page::write(SDL_Surface *image, const Rect &region)
+{
+    if (this->pixels == nullptr)
+    {
+        SDL_Rect destination = {region.x, region.y, image->w, image->h};
+        SDL_UpdateTexture(this->texture, &destination, image->pixels, image->pitch);
+        return;
+    }
+    uint8_t *page_pixels = static_cast<uint8_t *>(this->pixels->pixels);
+    for (int y = 0; y < region.h; ++y)
+    {
+        uint8_t *row = page_pixels + (region.y + y) * this->pixels->pitch + region.x * 4;
+        if (y < image->h)
+        {
+            memcpy(row, static_cast<uint8_t *>(image->pixels) + y * image->pitch, image->w * 4);
+            memset(row + image->w * 4, 0, (region.w - image->w) * 4);
+        }
+        else
+        {
+            memset(row, 0, region.w * 4);
+        }
+    }
+    SDL_UpdateTexture(this->texture, &region, page_pixels + region.y * this->pixels->pitch + region.x * 4, this->pixels->pitch);
+}
+
+bool Atlas::Page::compact(std::vector<Rect *> &regions)
+{
+    if (this->pixels == nullptr)
+    {
+        return false;
+    }
+    // Tallest first packs a skyline tightest.
+    std::vector<int> order(regions.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&regions](int a, int b) {
+        return regions[a]->h > regions[b]->h;
+    });
+    Atlas::Packer packer;
+    packer.reset(this->dimensions);
+    std::vector<Rect> placements(regions.size());
+    for (int i : order)
+    {
+        if (!packer.insert({regions[i]->w, regions[i]->h}, &placements[i]))
+        {
+            return false;
+        }
+    }
+    SDL_Surface *pixels = SDL_CreateRGBSurfaceWithFormat(0, this->dimensions.x, this->dimensions.y, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (pixels == nullptr)
+    {
+        printf("Unable to compact atlas page! SDL Error: %s\n", SDL_GetError());
+        return false;
+    }
+    for (size_t i = 0; i < regions.size(); ++i)
+    {
+        const Rect *from = regions[i];
+        const Rect *to = &placements[i];
+        for (int y = 0; y < from->h; ++y)
+        {
+            memcpy(
+                static_cast<uint8_t *>(pixels->pixels) + (to->y + y) * pixels->pitch + to->x * 4,
+                static_cast<uint8_t *>(this->pixels->pixels) + (from->y + y) * this->pixels->pitch + from->x * 4,
+                from->w * 4);
+        }
+        *regions[i] = *to;
+    }
+    SDL_FreeSurface(this->pixels);
+    this->pixels = pixels;
+    this->packer = packer;
+    SDL_UpdateTexture(this->texture, nullptr, pixels->pixels, pixels->pitch);
+    return true;
+}
+
+V2 Atlas::page_dimensions(SDL_Renderer *renderer, int size)
+{
+    SDL_RendererInfo info;
+    V2 dimensions = {size, size};
+    if (SDL_GetRendererInfo(renderer, &info) == 0)
+    {
+        if (info.max_texture_width > 0)
+        {
+            dimensions.x = std::min(dimensions.x, info.max_texture_width);
+        }
+        if (info.max_texture_height > 0)
+        {
+            dimensions.y = std::min(dimensions.y, info.max_texture_height);
+        }
+    }
+    return dimensions;
+}
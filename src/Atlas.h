@@ -0,0 +1,61 @@
+#ifndef ATLAS_h_
+#define ATLAS_h_
+
+#include "GameTypes.h"
+#include <vector>
+
+// Texture atlases. Sprite sheets and small generated textures (like text) are
+// packed into a few large pages so the renderer can batch sprites that come
+// from different images.
+namespace Atlas
+{
+const static int PAGE_SIZE = 2048;
+const static int DYNAMIC_PAGE_SIZE = 1024;
+const static int MAX_PAGES = 16;
+// Empty pixels kept around every image so filtering never bleeds between
+// neighbours.
+const static int PADDING = 1;
+
+// Skyline bottom-left packer: tracks the top edge of everything placed so far
+// and puts each new rect where its top ends up lowest.
+struct Packer
+{
+    Packer();
+    void reset(V2 dimensions);
+    // Finds room for size, padding included. Returns false if it doesn't fit.
+    bool insert(V2 size, Rect *placement);
+    struct Span
+    {
+        int x;
+        int y;
+        int w;
+    };
+    V2 dimensions;
+    std::vector<Atlas::Packer::Span> skyline;
+};
+
+// One atlas texture. Dynamic pages hold generated textures that come and go,
+// so they keep a copy of their pixels to repack from.
+struct Page
+{
+    Page(SDL_Renderer *, const V2 &dimensions, bool dynamic);
+    ~Page();
+    // Copies image (ARGB8888) into the top left of region. On dynamic pages
+    // the rest of region is cleared.
+    void write(SDL_Surface *image, const Rect &region);
+    // Packs the live regions again from scratch into a fresh copy of the
+    // page. On success regions are updated in place; otherwise nothing
+    // changes.
+    bool compact(std::vector<Rect *> &regions);
+    SDL_Texture *texture;
+    SDL_Surface *pixels;
+    Atlas::Packer packer;
+    V2 dimensions;
+    bool dynamic;
+};
+
+// Largest page the renderer supports, up to size.
+V2 page_dimensions(SDL_Renderer *, int size);
+}; // namespace Atlas
+
+#endif
@@ -0,0 +1,36 @@
+#include "Atoms.h"
+#include <deque>
+#include <unordered_map>
+#include <stdio.h>
+
+// deque so references handed out by resolve survive new interns.
+static std::deque<std::string> atom_table = {""};
+static std::unordered_map<std::string, Atoms::Atom> atom_map = {{"", Atoms::EMPTY_ATOM}};
+
+Atoms::Atom Atoms::intern(const std::string &s)
+{
+    auto it = atom_map.find(s);
+    if (it != atom_map.end())
+    {
+        return it->second;
+    }
+    Atoms::Atom atom = atom_table.size();
+    atom_table.push_back(s);
+    atom_map[s] = atom;
+    return atom;
+}
+
+const std::string &Atoms::resolve(Atoms::Atom atom)
+{
+    if (atom >= atom_table.size())
+    {
+        printf("Error: Atoms::resolve received an unknown atom %u\n", atom);
+        return atom_table[Atoms::EMPTY_ATOM];
+    }
+    return atom_table[atom];
+}
+
+int Atoms::size()
+{
+    return atom_table.size();
+}
@@ -0,0 +1,19 @@
+#ifndef ATOMS_h_
+#define ATOMS_h_
+
+#include <stdint.h>
+#include <string>
+
+// Engine-wide string interning. Components store an Atom (a 32-bit id) instead
+// of a string so they stay plain data that can be memcpy'd around. The same
+// string always interns to the same Atom for the life of the program.
+namespace Atoms
+{
+typedef uint32_t Atom;
+const static Atom EMPTY_ATOM = 0;
+Atom intern(const std::string &);
+const std::string &resolve(Atom);
+int size();
+} // namespace Atoms
+
+#endif
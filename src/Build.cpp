@@ -23,7 +23,7 @@ void Build::Manager::update(ECS::Map *map, double ts)
         Color green = {0x00, 0xFF, 0x00, 0x5F};
         Color red = {0xBB, 0x0A, 0x1E, 0x5F};
         Rect placeholder_rect = {(grid_position.x * map->cell_size) - camera->x, (grid_position.y * map->cell_size) - camera->y, map->cell_size, map->cell_size};
-        if (!map->grid[grid_position.x][grid_position.y].has_entity && !map->grid[grid_position.x][grid_position.y].tile.empty)
+        if (map->grid.is_cell_free(grid_position))
         {
             if (Input::is_input_active(Input::LEFT_MOUSE_JUST_PRESSED))
             {
@@ -62,30 +62,34 @@ void Build::Manager::update(ECS::Map *map, double ts)
             this->save_tile_placement(map);
             return;
         }
-        V2 current_mouse_grid_position = map->get_mouse_grid_position();
-        int start_x = std::min(this->start_floor_grid_position.x, current_mouse_grid_position.x);
-        int end_x = std::max(this->start_floor_grid_position.x, current_mouse_grid_position.x);
-        int start_y = std::min(this->start_floor_grid_position.y, current_mouse_grid_position.y);
-        int end_y = std::max(this->start_floor_grid_position.y, current_mouse_grid_position.y);
+        // One rectangle for the whole drag, coloured by whether all of it can
+        // be built on.
+        Rect area = this->get_dragged_area(map);
         Rect *camera = Window::get_camera();
-        if (start_x >= 0 && end_x < map->dimensions.x && start_y >= 0 && end_y < map->dimensions.y)
-        {
-            for (int i = start_x; i <= end_x; ++i)
-            {
-                for (int j = start_y; j <= end_y; ++j)
-                {
-                    Rect cell_to_render = {
-                        (static_cast<int>(i) * map->cell_size) - camera->x,
-                        (static_cast<int>(j) * map->cell_size) - camera->y,
-                        map->cell_size,
-                        map->cell_size};
-                    Color color = {0xFF, 0xFF, 0xFF, 0x6F};
-                    Render::render_rectangle(Render::Layer::WORLD_LAYER, cell_to_render, color, true, Render::Z_Index::FLOOR_LAYER);
-                }
-            }
-        }
+        Rect area_to_render = {
+            (area.x * map->cell_size) - camera->x,
+            (area.y * map->cell_size) - camera->y,
+            area.w * map->cell_size,
+            area.h * map->cell_size};
+        Color green = {0x00, 0xFF, 0x00, 0x5F};
+        Color red = {0xBB, 0x0A, 0x1E, 0x5F};
+        Render::render_rectangle(
+            Render::Layer::WORLD_LAYER,
+            area_to_render,
+            map->grid.is_area_free(area) ? green : red,
+            true,
+            Render::Z_Index::FLOOR_LAYER);
     }
 };
+Rect Build::Manager::get_dragged_area(ECS::Map *map)
+{
+    V2 current_mouse_grid_position = map->get_mouse_grid_position();
+    int start_x = std::min(this->start_floor_grid_position.x, current_mouse_grid_position.x);
+    int end_x = std::max(this->start_floor_grid_position.x, current_mouse_grid_position.x);
+    int start_y = std::min(this->start_floor_grid_position.y, current_mouse_grid_position.y);
+    int end_y = std::max(this->start_floor_grid_position.y, current_mouse_grid_position.y);
+    return {start_x, start_y, end_x - start_x + 1, end_y - start_y + 1};
+}
 void Build::Manager::begin_entity_placement(const ECS::Entity *blueprint)
 {
     this->state = Build::WAITING_TO_BUILD_ENTITY;
@@ -107,26 +111,17 @@ void Build::Manager::save_entity_placement(ECS::Map *map)
 };
 void Build::Manager::save_tile_placement(ECS::Map *map)
 {
-    // TODO: consolidate similar code in Build::Manager::update
     this->state = Build::WAITING_TO_BUILD_TILE;
-    V2 current_mouse_grid_position = map->get_mouse_grid_position();
-    int start_x = std::min(this->start_floor_grid_position.x, current_mouse_grid_position.x);
-    int end_x = std::max(this->start_floor_grid_position.x, current_mouse_grid_position.x);
-    int start_y = std::min(this->start_floor_grid_position.y, current_mouse_grid_position.y);
-    int end_y = std::max(this->start_floor_grid_position.y, current_mouse_grid_position.y);
-    if (start_x >= 0 && end_x < map->dimensions.x && start_y >= 0 && end_y < map->dimensions.y)
+    Rect area = this->get_dragged_area(map);
+    // Same check as the preview: every cell has a tile, nothing stands on
+    // it and none of it is off the map.
+    if (map->grid.is_area_free(area))
     {
-        for (int i = start_x; i <= end_x; ++i)
-        {
-            for (int j = start_y; j <= end_y; ++j)
-            {
-                MBus::Message message;
-                message.type = MBus::CREATE_TILE;
-                message.data.ct.grid_position = {static_cast<int>(i), static_cast<int>(j)};
-                message.data.ct.blueprint = this->blueprint;
-                MBus::send_ecs_message(&message);
-            }
-        }
+        MBus::Message message;
+        message.type = MBus::FILL_TILE_RECT;
+        message.data.ftr.area = area;
+        message.data.ftr.blueprint = this->blueprint;
+        MBus::send_ecs_message(&message);
     }
 };
 void Build::Manager::quit_entity_placement()
@@ -34,6 +34,8 @@ struct Manager
     void save_tile_placement(ECS::Map *);
     void quit_entity_placement();
     void quit_tile_placement();
+    // Grid-space rect between where the floor drag started and the mouse.
+    Rect get_dragged_area(ECS::Map *);
 
     V2 start_floor_grid_position;
     State state;
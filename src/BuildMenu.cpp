@@ -98,9 +98,9 @@ void BuildMenu::update(double ts, double bottom_y) // bottom_y is where this men
         {
             if (buildable.entity.component_flags & ECS::RENDER_FLAG)
             {
-                ECS::Component *render_component = buildable.entity.get_component(ECS::RENDER);
+                ECS::RenderComponent *render_component = buildable.entity.get<ECS::RenderComponent>();
                 assert(render_component != nullptr);
-                ECS::RenderComponent render_data = render_component->data.r;
+                ECS::RenderComponent render_data = *render_component;
                 V2 render_position = {curr_x, curr_y};
                 int scale = render_data.scale * 2;
                 Render::render_texture(
@@ -1,8 +1,9 @@
 #include "Debug.h"
 #include "MessageBus.h"
 #include "Window.h"
+#include <stdio.h>
 
-Debug::Debug() : entities_rendered(0), messages_in_render_queue(0), tiles_rendered(0), entities_processed(0)
+Debug::Debug() : entities_rendered(0), messages_in_render_queue(0), render_queue_high_water_mark(0), draw_calls(0), draw_call_batches(0), state_changes_issued(0), state_changes_elided(0), tiles_rendered(0), entities_processed(0)
 {
     this->debug_panel.rect_color = {0x11, 0x11, 0x11, 0xAF};
     this->debug_panel.outline_color = {0x00, 0x00, 0x00, 0xFF};
@@ -21,6 +22,24 @@ Debug::Debug() : entities_rendered(0), messages_in_render_queue(0), tiles_render
     this->messages_in_render_queue_text.z_index = 2;
     this->messages_in_render_queue_text.texture_key = "messages_in_render_queue_text";
 
+    this->render_queue_high_water_mark_text.font_index = 0;
+    this->render_queue_high_water_mark_text.has_overflow_clip = false;
+    this->render_queue_high_water_mark_text.render_layer = Render::GUI_LAYER;
+    this->render_queue_high_water_mark_text.z_index = 2;
+    this->render_queue_high_water_mark_text.texture_key = "render_queue_high_water_mark_text";
+
+    this->draw_calls_text.font_index = 0;
+    this->draw_calls_text.has_overflow_clip = false;
+    this->draw_calls_text.render_layer = Render::GUI_LAYER;
+    this->draw_calls_text.z_index = 2;
+    this->draw_calls_text.texture_key = "draw_calls_text";
+
+    this->state_changes_text.font_index = 0;
+    this->state_changes_text.has_overflow_clip = false;
+    this->state_changes_text.render_layer = Render::GUI_LAYER;
+    this->state_changes_text.z_index = 2;
+    this->state_changes_text.texture_key = "state_changes_text";
+
     this->tiles_rendered_text.font_index = 0;
     this->tiles_rendered_text.has_overflow_clip = false;
     this->tiles_rendered_text.render_layer = Render::GUI_LAYER;
@@ -36,18 +55,22 @@ Debug::Debug() : entities_rendered(0), messages_in_render_queue(0), tiles_render
 void Debug::update(double ts)
 {
     this->debug_panel.rect.x = (Window::get_gui_camera()->w - this->debug_panel.rect.w) - 5;
-    converter.str("");
-    converter << "Entities Rendered: " << this->entities_rendered;
-    this->entities_rendered_text.set_text(this->converter.str());
-    converter.str("");
-    converter << "In Render Queue: " << this->messages_in_render_queue;
-    this->messages_in_render_queue_text.set_text(this->converter.str());
-    converter.str("");
-    converter << "Tiles Rendered: " << this->tiles_rendered;
-    this->tiles_rendered_text.set_text(this->converter.str());
-    converter.str("");
-    converter << "Entities Processed: " << this->entities_processed;
-    this->entities_processed_text.set_text(this->converter.str());
+    // Text only lays out strings it hasn't seen, so formatting every frame is cheap.
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "Entities Rendered: %d", this->entities_rendered);
+    this->entities_rendered_text.set_text(buffer);
+    snprintf(buffer, sizeof(buffer), "In Render Queue: %d", this->messages_in_render_queue);
+    this->messages_in_render_queue_text.set_text(buffer);
+    snprintf(buffer, sizeof(buffer), "Render Queue Peak: %d", this->render_queue_high_water_mark);
+    this->render_queue_high_water_mark_text.set_text(buffer);
+    snprintf(buffer, sizeof(buffer), "Draw Calls: %d (%d batches)", this->draw_calls, this->draw_call_batches);
+    this->draw_calls_text.set_text(buffer);
+    snprintf(buffer, sizeof(buffer), "State Changes: %d (%d skipped)", this->state_changes_issued, this->state_changes_elided);
+    this->state_changes_text.set_text(buffer);
+    snprintf(buffer, sizeof(buffer), "Tiles Rendered: %d", this->tiles_rendered);
+    this->tiles_rendered_text.set_text(buffer);
+    snprintf(buffer, sizeof(buffer), "Entities Processed: %d", this->entities_processed);
+    this->entities_processed_text.set_text(buffer);
 
     this->entities_processed_text.position = {
         this->debug_panel.rect.x + 20,
@@ -61,12 +84,24 @@ void Debug::update(double ts)
     this->messages_in_render_queue_text.position = {
         this->debug_panel.rect.x + 20,
         this->tiles_rendered_text.position.y + this->tiles_rendered_text.dimensions.y};
+    this->render_queue_high_water_mark_text.position = {
+        this->debug_panel.rect.x + 20,
+        this->messages_in_render_queue_text.position.y + this->messages_in_render_queue_text.dimensions.y};
+    this->draw_calls_text.position = {
+        this->debug_panel.rect.x + 20,
+        this->render_queue_high_water_mark_text.position.y + this->render_queue_high_water_mark_text.dimensions.y};
+    this->state_changes_text.position = {
+        this->debug_panel.rect.x + 20,
+        this->draw_calls_text.position.y + this->draw_calls_text.dimensions.y};
 
-    this->debug_panel.rect.h = this->messages_in_render_queue_text.position.y + this->messages_in_render_queue_text.dimensions.y - this->entities_processed_text.position.y + 10;
+    this->debug_panel.rect.h = this->state_changes_text.position.y + this->state_changes_text.dimensions.y - this->entities_processed_text.position.y + 10;
 
     this->debug_panel.update(ts);
     this->entities_rendered_text.update(ts);
     this->messages_in_render_queue_text.update(ts);
+    this->render_queue_high_water_mark_text.update(ts);
+    this->draw_calls_text.update(ts);
+    this->state_changes_text.update(ts);
     this->tiles_rendered_text.update(ts);
     this->entities_processed_text.update(ts);
 }
@@ -74,6 +109,10 @@ void Debug::process_messages()
 {
     this->entities_rendered = 0;
     this->messages_in_render_queue = 0;
+    this->draw_calls = 0;
+    this->draw_call_batches = 0;
+    this->state_changes_issued = 0;
+    this->state_changes_elided = 0;
     this->tiles_rendered = 0;
     this->entities_processed = 0;
     MBus::MessageQueue mq = MBus::get_queue(MBus::QueueType::DEBUG);
@@ -92,6 +131,23 @@ void Debug::process_messages()
             this->messages_in_render_queue = m.data.mirq.num;
             break;
         }
+        case MBus::RENDER_QUEUE_HIGH_WATER_MARK:
+        {
+            this->render_queue_high_water_mark = m.data.rqhwm.num;
+            break;
+        }
+        case MBus::DRAW_CALLS:
+        {
+            this->draw_calls = m.data.dc.num;
+            this->draw_call_batches = m.data.dc.batches;
+            break;
+        }
+        case MBus::RENDER_STATE_CHANGES:
+        {
+            this->state_changes_issued = m.data.rsc.issued;
+            this->state_changes_elided = m.data.rsc.elided;
+            break;
+        }
         case MBus::TILES_RENDERED:
         {
             this->tiles_rendered = m.data.tr.num;
@@ -2,7 +2,6 @@
 #define DEBUG_h_
 
 #include "UI.h"
-#include <sstream>
 
 struct Debug
 {
@@ -12,11 +11,18 @@ struct Debug
     UI::Panel debug_panel;
     UI::Text entities_rendered_text;
     UI::Text messages_in_render_queue_text;
+    UI::Text render_queue_high_water_mark_text;
+    UI::Text draw_calls_text;
+    UI::Text state_changes_text;
     UI::Text tiles_rendered_text;
     UI::Text entities_processed_text;
-    std::stringstream converter;
     int entities_rendered;
     int messages_in_render_queue;
+    int render_queue_high_water_mark;
+    int draw_calls;
+    int draw_call_batches;
+    int state_changes_issued;
+    int state_changes_elided;
     int tiles_rendered;
     int entities_processed;
 };
@@ -1,4 +1,5 @@
 #include "Entity.h"
+#include "Scheduler.h"
 #include "Window.h"
 #include "Input.h"
 #include "Physics.h"
@@ -6,51 +7,970 @@
 #include "Assets.h"
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 
 ECS::Entity::Entity()
 {
-    this->components = new ECS::Component[ECS::NUM_COMPONENT_TYPES];
     this->component_length = 0;
     this->component_flags = 0;
+    this->prototype_id = -1;
+    for (int i = 0; i < ECS::NUM_COMPONENT_TYPES; ++i)
+    {
+        this->component_slots[i] = -1;
+    }
+}
+void ECS::Entity::add_component(ECS::Component *c)
+{
+    int slot = this->component_slots[c->type];
+    if (slot >= 0)
+    {
+        // Already has one of these, overwrite it in place.
+        this->components[slot] = *c;
+        return;
+    }
+    if (this->component_length >= ECS::NUM_COMPONENT_TYPES - 1)
+    {
+        printf("WARNING: Entity component list is full and should not be full\n");
+        return;
+    }
+    this->component_slots[c->type] = this->component_length;
+    this->components[this->component_length++] = *c;
+    this->component_flags |= (1 << c->type);
+}
+ECS::Component *ECS::Entity::get_component(ECS::Type type)
+{
+    int slot = this->component_slots[type];
+    return slot < 0 ? nullptr : &this->components[slot];
+}
+const ECS::Component *ECS::Entity::get_component(ECS::Type type) const
+{
+    int slot = this->component_slots[type];
+    return slot < 0 ? nullptr : &this->components[slot];
+}
+
+int ECS::component_data_size(ECS::Type type)
+{
+    switch (type)
+    {
+    case ECS::POSITION:
+        return sizeof(ECS::PositionComponent);
+    case ECS::RENDER:
+        return sizeof(ECS::RenderComponent);
+    case ECS::POSITION_ANIMATE:
+        return sizeof(ECS::PositionAnimateComponent);
+    case ECS::BUILD_COST:
+        return sizeof(ECS::BuildCostComponent);
+    case ECS::INFO:
+        return sizeof(ECS::InfoComponent);
+    default:
+        // Tag components (CAMERA, PLAYER_INPUT, ...) carry no data.
+        return 0;
+    }
+}
+
+// Prototypes
+
+static std::vector<ECS::Entity> prototype_table;
+// Largest on-screen size of any prototype, so tile culling knows how far a
+// tile can hang over neighbouring cells.
+static int max_prototype_render_size = 0;
+
+int ECS::register_prototype(ECS::Entity *e)
+{
+    e->prototype_id = prototype_table.size();
+    prototype_table.push_back(*e);
+    const ECS::RenderComponent *render_component = e->get<ECS::RenderComponent>();
+    if (render_component != nullptr && render_component->has_clip)
+    {
+        max_prototype_render_size = std::max(
+            max_prototype_render_size,
+            std::max(render_component->clip.w, render_component->clip.h) * render_component->scale);
+    }
+    return e->prototype_id;
+}
+
+static bool same_rect(const Rect &a, const Rect &b)
+{
+    return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+// Field by field, since padding inside the component structs isn't
+// guaranteed to match.
+static bool same_component(const ECS::Component &a, const ECS::Component &b)
+{
+    switch (a.type)
+    {
+    case ECS::POSITION:
+        return a.data.p.position.x == b.data.p.position.x && a.data.p.position.y == b.data.p.position.y;
+    case ECS::RENDER:
+        return same_rect(a.data.r.clip, b.data.r.clip) && a.data.r.layer == b.data.r.layer &&
+               a.data.r.texture_index == b.data.r.texture_index && a.data.r.texture_key == b.data.r.texture_key &&
+               a.data.r.scale == b.data.r.scale && a.data.r.z_index == b.data.r.z_index && a.data.r.has_clip == b.data.r.has_clip;
+    case ECS::POSITION_ANIMATE:
+        return a.data.p_a.start.x == b.data.p_a.start.x && a.data.p_a.start.y == b.data.p_a.start.y &&
+               a.data.p_a.end.x == b.data.p_a.end.x && a.data.p_a.end.y == b.data.p_a.end.y &&
+               a.data.p_a.counter == b.data.p_a.counter && a.data.p_a.duration == b.data.p_a.duration;
+    case ECS::BUILD_COST:
+        return a.data.bc.amount == b.data.bc.amount;
+    case ECS::INFO:
+        return a.data.i.name == b.data.i.name && a.data.i.description == b.data.i.description;
+    default:
+        return true;
+    }
+}
+
+int ECS::find_prototype(const ECS::Entity *e)
+{
+    for (const ECS::Entity &prototype : prototype_table)
+    {
+        if (prototype.component_flags != e->component_flags)
+        {
+            continue;
+        }
+        bool same = true;
+        for (int i = 0; i < e->component_length && same; ++i)
+        {
+            const ECS::Component *component = prototype.get_component(e->components[i].type);
+            same = component != nullptr && same_component(*component, e->components[i]);
+        }
+        if (same)
+        {
+            return prototype.prototype_id;
+        }
+    }
+    return -1;
+}
+
+const ECS::Entity *ECS::get_prototype(int prototype_id)
+{
+    if (prototype_id < 0 || prototype_id >= static_cast<int>(prototype_table.size()))
+    {
+        return nullptr;
+    }
+    return &prototype_table[prototype_id];
+}
+
+// Archetype
+
+ECS::Archetype::Archetype(int component_flags) : component_flags(component_flags), length(0)
+{
+    for (int type = 0; type < ECS::NUM_COMPONENT_TYPES; ++type)
+    {
+        this->column_ticks[type] = 0;
+    }
+};
+
+void *ECS::Archetype::get_column(ECS::Type type)
+{
+    if (!(this->component_flags & (1 << type)) || this->columns[type].empty())
+    {
+        return nullptr;
+    }
+    return this->columns[type].data();
+}
+
+void ECS::Archetype::mark_changed(ECS::Type type, int begin, int end, unsigned int tick)
+{
+    if (!(this->component_flags & (1 << type)))
+    {
+        return;
+    }
+    std::fill(this->change_ticks[type].begin() + begin, this->change_ticks[type].begin() + end, tick);
+    this->column_ticks[type] = tick;
+}
+
+// Storage
+
+bool ECS::operator==(const ECS::EntityHandle &a, const ECS::EntityHandle &b)
+{
+    return a.index == b.index && a.generation == b.generation;
+}
+
+bool ECS::operator!=(const ECS::EntityHandle &a, const ECS::EntityHandle &b)
+{
+    return !(a == b);
+}
+
+ECS::Storage::Storage() : live_count(0), change_tick(1){};
+
+unsigned int ECS::Storage::bump_tick()
+{
+    return this->change_tick++;
+}
+
+int ECS::Storage::size() const
+{
+    return this->live_count;
+}
+
+int ECS::Storage::slot_count() const
+{
+    return this->locations.size();
+}
+
+int ECS::Storage::get_archetype_index(int component_flags)
+{
+    for (unsigned int i = 0; i < this->archetypes.size(); ++i)
+    {
+        if (this->archetypes[i].component_flags == component_flags)
+        {
+            return i;
+        }
+    }
+    this->archetypes.push_back(ECS::Archetype(component_flags));
+    return this->archetypes.size() - 1;
+}
+
+bool ECS::Storage::is_alive(ECS::EntityHandle handle) const
+{
+    return handle.index >= 0 &&
+           handle.index < static_cast<int>(this->locations.size()) &&
+           this->locations[handle.index].archetype_index != -1 &&
+           this->generations[handle.index] == handle.generation;
+}
+
+ECS::EntityHandle ECS::Storage::get_handle(int index) const
+{
+    assert(index >= 0 && index < this->slot_count());
+    return {index, this->generations[index]};
+}
+
+int ECS::Storage::allocate_index()
+{
+    int index = -1;
+    if (!this->free_indices.empty())
+    {
+        index = this->free_indices.back();
+        this->free_indices.pop_back();
+    }
+    else
+    {
+        index = this->locations.size();
+        this->locations.push_back({-1, -1});
+        this->generations.push_back(0);
+    }
+    ++this->live_count;
+    return index;
+}
+
+ECS::EntityHandle ECS::Storage::create_entity(const ECS::Entity &e)
+{
+    int index = this->allocate_index();
+    this->locations[index] = this->insert_row(index, e.component_flags, e.prototype_id, e.components, e.component_length);
+    return {index, this->generations[index]};
+}
+
+ECS::EntityHandle ECS::Storage::create_instance(int prototype_id, const ECS::Component *overrides, int override_count)
+{
+    assert(ECS::get_prototype(prototype_id) != nullptr);
+    int index = this->allocate_index();
+    this->locations[index] = this->insert_row(index, 0, prototype_id, overrides, override_count);
+    return {index, this->generations[index]};
+}
+
+void ECS::Storage::destroy_entity(ECS::EntityHandle handle)
+{
+    if (!this->is_alive(handle))
+    {
+        printf("WARNING: Tried to destroy a stale entity handle %d:%d\n", handle.index, handle.generation);
+        return;
+    }
+    this->remove_row(this->locations[handle.index]);
+    this->locations[handle.index] = {-1, -1};
+    ++this->generations[handle.index];
+    this->free_indices.push_back(handle.index);
+    --this->live_count;
+}
+
+void ECS::Storage::replace_entity(ECS::EntityHandle handle, const ECS::Entity &e)
+{
+    assert(this->is_alive(handle));
+    this->remove_row(this->locations[handle.index]);
+    this->locations[handle.index] = this->insert_row(handle.index, e.component_flags, e.prototype_id, e.components, e.component_length);
+}
+
+void ECS::Storage::replace_instance(ECS::EntityHandle handle, int prototype_id, const ECS::Component *overrides, int override_count)
+{
+    assert(this->is_alive(handle));
+    const ECS::Entity *prototype = ECS::get_prototype(prototype_id);
+    assert(prototype != nullptr);
+    ECS::EntityLocation location = this->locations[handle.index];
+    int component_flags = prototype->component_flags;
+    for (int i = 0; i < override_count; ++i)
+    {
+        component_flags |= 1 << overrides[i].type;
+    }
+    if (this->archetypes[location.archetype_index].component_flags == component_flags)
+    {
+        // Same signature (e.g. painting one floor over another), overwrite in place.
+        this->write_row(&this->archetypes[location.archetype_index], location.row, prototype_id, overrides, override_count);
+        return;
+    }
+    this->remove_row(location);
+    this->locations[handle.index] = this->insert_row(handle.index, 0, prototype_id, overrides, override_count);
+}
+
+ECS::Entity ECS::Storage::make_entity(ECS::EntityHandle handle)
+{
+    assert(this->is_alive(handle));
+    ECS::EntityLocation location = this->locations[handle.index];
+    ECS::Archetype *archetype = &this->archetypes[location.archetype_index];
+    ECS::Entity e;
+    for (int type = 0; type < ECS::NUM_COMPONENT_TYPES; ++type)
+    {
+        if (archetype->component_flags & (1 << type))
+        {
+            int size = ECS::component_data_size(static_cast<ECS::Type>(type));
+            ECS::Component c;
+            c.type = static_cast<ECS::Type>(type);
+            if (size > 0)
+            {
+                memcpy(&c.data, &archetype->columns[type][location.row * size], size);
+            }
+            e.add_component(&c);
+        }
+    }
+    e.prototype_id = archetype->prototype_ids[location.row];
+    return e;
+}
+
+void *ECS::Storage::get_component(ECS::EntityHandle handle, ECS::Type type)
+{
+    if (!this->is_alive(handle))
+    {
+        return nullptr;
+    }
+    ECS::EntityLocation location = this->locations[handle.index];
+    ECS::Archetype *archetype = &this->archetypes[location.archetype_index];
+    unsigned char *column = static_cast<unsigned char *>(archetype->get_column(type));
+    if (column == nullptr)
+    {
+        return nullptr;
+    }
+    // Handing out a mutable pointer counts as a write.
+    archetype->mark_changed(type, location.row, location.row + 1, this->change_tick);
+    return column + location.row * ECS::component_data_size(type);
+}
+
+const void *ECS::Storage::get_component(ECS::EntityHandle handle, ECS::Type type) const
+{
+    if (!this->is_alive(handle))
+    {
+        return nullptr;
+    }
+    ECS::EntityLocation location = this->locations[handle.index];
+    const ECS::Archetype *archetype = &this->archetypes[location.archetype_index];
+    if (!(archetype->component_flags & (1 << type)) || archetype->columns[type].empty())
+    {
+        return nullptr;
+    }
+    return archetype->columns[type].data() + location.row * ECS::component_data_size(type);
+}
+
+ECS::EntityLocation ECS::Storage::insert_row(int index, int component_flags, int prototype_id, const ECS::Component *components, int length)
+{
+    const ECS::Entity *prototype = ECS::get_prototype(prototype_id);
+    if (prototype != nullptr)
+    {
+        component_flags |= prototype->component_flags;
+    }
+    for (int i = 0; i < length; ++i)
+    {
+        component_flags |= 1 << components[i].type;
+    }
+    int archetype_index = this->get_archetype_index(component_flags);
+    ECS::Archetype *archetype = &this->archetypes[archetype_index];
+    int row = archetype->length++;
+    archetype->entity_indices.push_back(index);
+    archetype->prototype_ids.push_back(prototype_id);
+    for (int type = 0; type < ECS::NUM_COMPONENT_TYPES; ++type)
+    {
+        if (archetype->component_flags & (1 << type))
+        {
+            int size = ECS::component_data_size(static_cast<ECS::Type>(type));
+            archetype->columns[type].resize(archetype->columns[type].size() + size);
+            archetype->change_ticks[type].push_back(this->change_tick);
+        }
+    }
+    this->write_row(archetype, row, prototype_id, components, length);
+    return {archetype_index, row};
+}
+
+void ECS::Storage::write_row(ECS::Archetype *archetype, int row, int prototype_id, const ECS::Component *components, int length)
+{
+    const ECS::Entity *prototype = ECS::get_prototype(prototype_id);
+    archetype->prototype_ids[row] = prototype_id;
+    for (int type = 0; type < ECS::NUM_COMPONENT_TYPES; ++type)
+    {
+        archetype->mark_changed(static_cast<ECS::Type>(type), row, row + 1, this->change_tick);
+    }
+    if (prototype != nullptr)
+    {
+        for (int i = 0; i < prototype->component_length; ++i)
+        {
+            const ECS::Component *c = &prototype->components[i];
+            int size = ECS::component_data_size(c->type);
+            if (size > 0)
+            {
+                memcpy(&archetype->columns[c->type][row * size], &c->data, size);
+            }
+        }
+    }
+    for (int i = 0; i < length; ++i)
+    {
+        const ECS::Component *c = &components[i];
+        if (!(archetype->component_flags & (1 << c->type)))
+        {
+            continue;
+        }
+        int size = ECS::component_data_size(c->type);
+        if (size > 0)
+        {
+            memcpy(&archetype->columns[c->type][row * size], &c->data, size);
+        }
+    }
+}
+
+void ECS::Storage::remove_row(ECS::EntityLocation location)
+{
+    // Swap the last row into the hole so columns stay dense.
+    ECS::Archetype *archetype = &this->archetypes[location.archetype_index];
+    int last = archetype->length - 1;
+    for (int type = 0; type < ECS::NUM_COMPONENT_TYPES; ++type)
+    {
+        if (archetype->component_flags & (1 << type))
+        {
+            int size = ECS::component_data_size(static_cast<ECS::Type>(type));
+            if (size > 0)
+            {
+                if (location.row != last)
+                {
+                    memcpy(&archetype->columns[type][location.row * size], &archetype->columns[type][last * size], size);
+                }
+                archetype->columns[type].resize(last * size);
+            }
+            // Moving a row isn't a change.
+            archetype->change_ticks[type][location.row] = archetype->change_ticks[type][last];
+            archetype->change_ticks[type].pop_back();
+        }
+    }
+    if (location.row != last)
+    {
+        int moved_index = archetype->entity_indices[last];
+        archetype->entity_indices[location.row] = moved_index;
+        archetype->prototype_ids[location.row] = archetype->prototype_ids[last];
+        this->locations[moved_index].row = location.row;
+    }
+    archetype->entity_indices.pop_back();
+    archetype->prototype_ids.pop_back();
+    archetype->length = last;
+}
+
+// Spatial hash
+
+static int64_t bucket_key(int x, int y)
+{
+    return (static_cast<int64_t>(x) << 32) | static_cast<uint32_t>(y);
+}
+
+// Floor division so negative coordinates land in the right bucket.
+static int bucket_coordinate(int value, int bucket_size)
+{
+    return value >= 0 ? value / bucket_size : -((-value + bucket_size - 1) / bucket_size);
+}
+
+ECS::SpatialHash::SpatialHash(int bucket_size) : bucket_size(bucket_size), seen_tick(0), query_stamp(0){};
+
+Rect ECS::SpatialHash::get_bucket_range(Rect bounds) const
+{
+    int start_x = bucket_coordinate(bounds.x, this->bucket_size);
+    int start_y = bucket_coordinate(bounds.y, this->bucket_size);
+    int end_x = bucket_coordinate(bounds.x + std::max(bounds.w, 1) - 1, this->bucket_size);
+    int end_y = bucket_coordinate(bounds.y + std::max(bounds.h, 1) - 1, this->bucket_size);
+    return {start_x, start_y, end_x - start_x + 1, end_y - start_y + 1};
+}
+
+void ECS::SpatialHash::insert(int index, ECS::EntityHandle handle, Rect bounds)
+{
+    if (index >= static_cast<int>(this->records.size()))
+    {
+        this->records.resize(index + 1, {ECS::NULL_ENTITY, {0, 0, 0, 0}, false});
+        this->query_marks.resize(index + 1, 0);
+    }
+    this->records[index] = {handle, bounds, true};
+    Rect range = this->get_bucket_range(bounds);
+    for (int y = range.y; y < range.y + range.h; ++y)
+    {
+        for (int x = range.x; x < range.x + range.w; ++x)
+        {
+            this->buckets[bucket_key(x, y)].push_back(index);
+        }
+    }
+}
+
+void ECS::SpatialHash::remove(int index)
+{
+    if (index >= static_cast<int>(this->records.size()) || !this->records[index].indexed)
+    {
+        return;
+    }
+    Rect range = this->get_bucket_range(this->records[index].bounds);
+    for (int y = range.y; y < range.y + range.h; ++y)
+    {
+        for (int x = range.x; x < range.x + range.w; ++x)
+        {
+            auto bucket = this->buckets.find(bucket_key(x, y));
+            if (bucket == this->buckets.end())
+            {
+                continue;
+            }
+            std::vector<int> &indices = bucket->second;
+            auto it = std::find(indices.begin(), indices.end(), index);
+            if (it != indices.end())
+            {
+                *it = indices.back();
+                indices.pop_back();
+            }
+            if (indices.empty())
+            {
+                this->buckets.erase(bucket);
+            }
+        }
+    }
+    this->records[index].indexed = false;
+}
+
+void ECS::SpatialHash::update(ECS::Storage *storage)
+{
+    storage->view<const ECS::PositionComponent>()
+        .changed<ECS::PositionComponent, ECS::RenderComponent>(this->seen_tick)
+        .each_with_index([this, storage](int index, const ECS::PositionComponent &position) {
+            ECS::EntityHandle handle = storage->get_handle(index);
+            const ECS::RenderComponent *render = storage->read<ECS::RenderComponent>(handle);
+            Rect bounds = {position.position.x, position.position.y, 1, 1};
+            if (render != nullptr)
+            {
+                bounds = ECS::render_bounds(&position, render);
+            }
+            if (index < static_cast<int>(this->records.size()) && this->records[index].indexed)
+            {
+                const Record &record = this->records[index];
+                if (record.handle == handle && record.bounds.x == bounds.x && record.bounds.y == bounds.y &&
+                    record.bounds.w == bounds.w && record.bounds.h == bounds.h)
+                {
+                    return;
+                }
+                this->remove(index);
+            }
+            this->insert(index, handle, bounds);
+        });
+    this->seen_tick = storage->bump_tick();
+}
+
+void ECS::SpatialHash::query_indices(Rect area, std::vector<int> *indices) const
+{
+    if (++this->query_stamp == 0)
+    {
+        // Wrapped around, old stamps could collide.
+        std::fill(this->query_marks.begin(), this->query_marks.end(), 0);
+        this->query_stamp = 1;
+    }
+    Rect range = this->get_bucket_range(area);
+    for (int y = range.y; y < range.y + range.h; ++y)
+    {
+        for (int x = range.x; x < range.x + range.w; ++x)
+        {
+            auto bucket = this->buckets.find(bucket_key(x, y));
+            if (bucket == this->buckets.end())
+            {
+                continue;
+            }
+            for (int index : bucket->second)
+            {
+                if (this->query_marks[index] == this->query_stamp)
+                {
+                    continue;
+                }
+                this->query_marks[index] = this->query_stamp;
+                Rect bounds = this->records[index].bounds;
+                if (Physics::check_collision(&area, &bounds))
+                {
+                    indices->push_back(index);
+                }
+            }
+        }
+    }
+}
+
+void ECS::SpatialHash::query_rect(const ECS::Storage *storage, Rect area, std::vector<ECS::EntityHandle> *handles) const
+{
+    std::vector<int> indices;
+    this->query_indices(area, &indices);
+    for (int index : indices)
+    {
+        if (storage->is_alive(this->records[index].handle))
+        {
+            handles->push_back(this->records[index].handle);
+        }
+    }
+}
+
+void ECS::SpatialHash::query_radius(const ECS::Storage *storage, V2 center, int radius, std::vector<ECS::EntityHandle> *handles) const
+{
+    std::vector<int> indices;
+    this->query_indices({center.x - radius, center.y - radius, radius * 2 + 1, radius * 2 + 1}, &indices);
+    for (int index : indices)
+    {
+        const Record &record = this->records[index];
+        if (!storage->is_alive(record.handle))
+        {
+            continue;
+        }
+        // Distance from the center to the closest point of the bounds.
+        int64_t dx = std::max(std::max(record.bounds.x - center.x, 0), center.x - (record.bounds.x + record.bounds.w - 1));
+        int64_t dy = std::max(std::max(record.bounds.y - center.y, 0), center.y - (record.bounds.y + record.bounds.h - 1));
+        if (dx * dx + dy * dy <= static_cast<int64_t>(radius) * radius)
+        {
+            handles->push_back(record.handle);
+        }
+    }
+}
+
+void ECS::SpatialHash::query_point(const ECS::Storage *storage, V2 point, std::vector<ECS::EntityHandle> *handles) const
+{
+    this->query_rect(storage, {point.x, point.y, 1, 1}, handles);
+}
+
+int ECS::SpatialHash::size() const
+{
+    int count = 0;
+    for (const Record &record : this->records)
+    {
+        if (record.indexed)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+// Grid
+
+ECS::TileLayer ECS::get_tile_layer(const ECS::Entity *prototype)
+{
+    const ECS::RenderComponent *render_component = prototype->get<ECS::RenderComponent>();
+    if (render_component == nullptr)
+    {
+        return ECS::OBJECT_TILE_LAYER;
+    }
+    switch (render_component->z_index)
+    {
+    case Render::Z_Index::TILE_BASE_LAYER:
+        return ECS::BASE_TILE_LAYER;
+    case Render::Z_Index::FLOOR_LAYER:
+        return ECS::FLOOR_TILE_LAYER;
+    default:
+        return ECS::OBJECT_TILE_LAYER;
+    }
+}
+
+static unsigned int next_chunk_version = 1;
+
+ECS::Chunk::Chunk() : tile_count(0), entity_count(0), uniform_dirty(false), version(0)
+{
+    for (ECS::Cell &cell : this->cells)
+    {
+        cell = {};
+    }
+    for (int layer = 0; layer < ECS::NUM_TILE_LAYERS; ++layer)
+    {
+        this->uniform_prototype_ids[layer] = ECS::EMPTY_LAYER;
+    }
+};
+
+ECS::Bitmap::Bitmap() : dimensions({0, 0}), words_per_row(0){};
+
+void ECS::Bitmap::resize(V2 dimensions)
+{
+    this->dimensions = dimensions;
+    this->words_per_row = (dimensions.x + 63) / 64;
+    this->words.assign(this->words_per_row * dimensions.y, 0);
+}
+
+void ECS::Bitmap::set(V2 position)
+{
+    this->words[position.y * this->words_per_row + position.x / 64] |= uint64_t(1) << (position.x % 64);
+}
+
+void ECS::Bitmap::clear(V2 position)
+{
+    this->words[position.y * this->words_per_row + position.x / 64] &= ~(uint64_t(1) << (position.x % 64));
+}
+
+bool ECS::Bitmap::test(V2 position) const
+{
+    return (this->words[position.y * this->words_per_row + position.x / 64] >> (position.x % 64)) & 1;
+}
+
+const uint64_t *ECS::Bitmap::row(int y) const
+{
+    return &this->words[y * this->words_per_row];
+}
+
+ECS::Grid::Grid() : dimensions({0, 0}), chunk_dimensions({0, 0}){};
+
+void ECS::Grid::resize(V2 dimensions)
+{
+    this->dimensions = dimensions;
+    this->chunk_dimensions = {
+        (dimensions.x + ECS::CHUNK_SIZE - 1) / ECS::CHUNK_SIZE,
+        (dimensions.y + ECS::CHUNK_SIZE - 1) / ECS::CHUNK_SIZE};
+    this->chunks.assign(this->chunk_dimensions.x * this->chunk_dimensions.y, ECS::Chunk());
+    this->entities.clear();
+    for (ECS::Bitmap &bits : this->layer_bits)
+    {
+        bits.resize(dimensions);
+    }
+    this->tile_bits.resize(dimensions);
+    this->entity_bits.resize(dimensions);
+}
+
+ECS::Chunk *ECS::Grid::get_chunk(V2 chunk_position)
+{
+    assert(chunk_position.x >= 0 && chunk_position.x < this->chunk_dimensions.x &&
+           chunk_position.y >= 0 && chunk_position.y < this->chunk_dimensions.y);
+    return &this->chunks[chunk_position.y * this->chunk_dimensions.x + chunk_position.x];
+}
+
+ECS::Chunk *ECS::Grid::get_cell_chunk(V2 grid_position)
+{
+    return this->get_chunk({grid_position.x / ECS::CHUNK_SIZE, grid_position.y / ECS::CHUNK_SIZE});
+}
+
+const ECS::Cell *ECS::Grid::get_cell(V2 grid_position) const
+{
+    assert(grid_position.x >= 0 && grid_position.x < this->dimensions.x &&
+           grid_position.y >= 0 && grid_position.y < this->dimensions.y);
+    const ECS::Chunk *chunk = &this->chunks[(grid_position.y / ECS::CHUNK_SIZE) * this->chunk_dimensions.x + grid_position.x / ECS::CHUNK_SIZE];
+    return &chunk->cells[(grid_position.y % ECS::CHUNK_SIZE) * ECS::CHUNK_SIZE + grid_position.x % ECS::CHUNK_SIZE];
 }
-void ECS::Entity::add_component(ECS::Component *c)
+
+ECS::Cell *ECS::Grid::get_mutable_cell(V2 grid_position)
 {
-    if (this->component_length >= ECS::NUM_COMPONENT_TYPES - 1)
+    return const_cast<ECS::Cell *>(this->get_cell(grid_position));
+}
+
+void ECS::Grid::set_tile(V2 grid_position, ECS::TileLayer layer, int prototype_id)
+{
+    assert(prototype_id >= 0 && prototype_id < UINT16_MAX);
+    ECS::Cell *cell = this->get_mutable_cell(grid_position);
+    ECS::Chunk *chunk = this->get_cell_chunk(grid_position);
+    if (!(cell->occupancy & ECS::CELL_HAS_TILE))
     {
-        printf("WARNING: Entity component list is full and should not be full\n");
-        return;
+        ++chunk->tile_count;
     }
-    this->components[this->component_length++] = *c;
-    this->component_flags |= (1 << c->type);
+    cell->tiles[layer] = static_cast<uint16_t>(prototype_id + 1);
+    cell->occupancy |= ECS::CELL_HAS_TILE;
+    this->layer_bits[layer].set(grid_position);
+    this->tile_bits.set(grid_position);
+    chunk->uniform_dirty = true;
+    chunk->version = next_chunk_version++;
 }
-ECS::Entity::~Entity()
+
+void ECS::Grid::set_entity(V2 grid_position, ECS::EntityHandle entity)
 {
-    // Can't free in destructor because entities get copied around a lot.
-    // delete[] this->components;
+    ECS::Cell *cell = this->get_mutable_cell(grid_position);
+    if (!(cell->occupancy & ECS::CELL_HAS_ENTITY))
+    {
+        ++this->get_cell_chunk(grid_position)->entity_count;
+    }
+    cell->occupancy |= ECS::CELL_HAS_ENTITY;
+    this->entity_bits.set(grid_position);
+    this->entities[grid_position.y * this->dimensions.x + grid_position.x] = entity;
 }
-ECS::Component *ECS::Entity::get_component(ECS::Type type)
+
+void ECS::Grid::clear_entity(V2 grid_position)
+{
+    ECS::Cell *cell = this->get_mutable_cell(grid_position);
+    if (cell->occupancy & ECS::CELL_HAS_ENTITY)
+    {
+        --this->get_cell_chunk(grid_position)->entity_count;
+    }
+    cell->occupancy &= ~ECS::CELL_HAS_ENTITY;
+    this->entity_bits.clear(grid_position);
+    this->entities.erase(grid_position.y * this->dimensions.x + grid_position.x);
+}
+
+bool ECS::Grid::is_cell_free(V2 grid_position) const
+{
+    return this->tile_bits.test(grid_position) && !this->entity_bits.test(grid_position);
+}
+
+bool ECS::Grid::is_area_free(Rect area) const
+{
+    int begin_x = std::max(area.x, 0);
+    int begin_y = std::max(area.y, 0);
+    int end_x = std::min(area.x + area.w, this->dimensions.x);
+    int end_y = std::min(area.y + area.h, this->dimensions.y);
+    // Anything hanging off the map can't be built on.
+    if (begin_x != area.x || begin_y != area.y || end_x != area.x + area.w || end_y != area.y + area.h)
+    {
+        return false;
+    }
+    for (int y = begin_y; y < end_y; ++y)
+    {
+        const uint64_t *tiles = this->tile_bits.row(y);
+        const uint64_t *entities = this->entity_bits.row(y);
+        for (int w = begin_x / 64; w <= (end_x - 1) / 64; ++w)
+        {
+            uint64_t mask = ECS::bitmap_word_mask(w, begin_x, end_x);
+            if ((tiles[w] & ~entities[w] & mask) != mask)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int ECS::Grid::count_free_cells(Rect area) const
+{
+    int begin_x = std::max(area.x, 0);
+    int begin_y = std::max(area.y, 0);
+    int end_x = std::min(area.x + area.w, this->dimensions.x);
+    int end_y = std::min(area.y + area.h, this->dimensions.y);
+    if (begin_x >= end_x)
+    {
+        return 0;
+    }
+    int first_word = begin_x / 64;
+    int last_word = (end_x - 1) / 64;
+    uint64_t first_mask = ECS::bitmap_word_mask(first_word, begin_x, end_x);
+    uint64_t last_mask = ECS::bitmap_word_mask(last_word, begin_x, end_x);
+    int count = 0;
+    for (int y = begin_y; y < end_y; ++y)
+    {
+        const uint64_t *tiles = this->tile_bits.row(y);
+        const uint64_t *entities = this->entity_bits.row(y);
+        if (first_word == last_word)
+        {
+            count += __builtin_popcountll(tiles[first_word] & ~entities[first_word] & first_mask);
+            continue;
+        }
+        count += __builtin_popcountll(tiles[first_word] & ~entities[first_word] & first_mask);
+        // Whole words in the middle need no masking, which lets the compiler
+        // vectorize this loop.
+        for (int w = first_word + 1; w < last_word; ++w)
+        {
+            count += __builtin_popcountll(tiles[w] & ~entities[w]);
+        }
+        count += __builtin_popcountll(tiles[last_word] & ~entities[last_word] & last_mask);
+    }
+    return count;
+}
+
+int ECS::Grid::count_tiles(Rect area) const
+{
+    int begin_x = std::max(area.x, 0);
+    int begin_y = std::max(area.y, 0);
+    int end_x = std::min(area.x + area.w, this->dimensions.x);
+    int end_y = std::min(area.y + area.h, this->dimensions.y);
+    if (begin_x >= end_x)
+    {
+        return 0;
+    }
+    int count = 0;
+    for (int layer = 0; layer < ECS::NUM_TILE_LAYERS; ++layer)
+    {
+        for (int y = begin_y; y < end_y; ++y)
+        {
+            const uint64_t *tiles = this->layer_bits[layer].row(y);
+            for (int w = begin_x / 64; w <= (end_x - 1) / 64; ++w)
+            {
+                count += __builtin_popcountll(tiles[w] & ECS::bitmap_word_mask(w, begin_x, end_x));
+            }
+        }
+    }
+    return count;
+}
+
+bool ECS::Grid::find_free_cell(Rect area, V2 *grid_position) const
 {
-    for (int i = 0; i < this->component_length; ++i)
+    int begin_x = std::max(area.x, 0);
+    int begin_y = std::max(area.y, 0);
+    int end_x = std::min(area.x + area.w, this->dimensions.x);
+    int end_y = std::min(area.y + area.h, this->dimensions.y);
+    if (begin_x >= end_x)
     {
-        if (this->components[i].type == type)
+        return false;
+    }
+    for (int y = begin_y; y < end_y; ++y)
+    {
+        const uint64_t *tiles = this->tile_bits.row(y);
+        const uint64_t *entities = this->entity_bits.row(y);
+        for (int w = begin_x / 64; w <= (end_x - 1) / 64; ++w)
         {
-            return &this->components[i];
+            uint64_t free = tiles[w] & ~entities[w] & ECS::bitmap_word_mask(w, begin_x, end_x);
+            if (free != 0)
+            {
+                *grid_position = {w * 64 + __builtin_ctzll(free), y};
+                return true;
+            }
         }
     }
-    return nullptr;
+    return false;
+}
+
+bool ECS::Grid::get_entity(V2 grid_position, ECS::EntityHandle *entity) const
+{
+    if (!(this->get_cell(grid_position)->occupancy & ECS::CELL_HAS_ENTITY))
+    {
+        return false;
+    }
+    auto it = this->entities.find(grid_position.y * this->dimensions.x + grid_position.x);
+    if (it == this->entities.end())
+    {
+        return false;
+    }
+    *entity = it->second;
+    return true;
 }
 
-ECS::Entity ECS::Entity::make_deep_copy() const
+void ECS::Grid::refresh_chunk(V2 chunk_position)
 {
-    ECS::Entity copy;
-    copy.component_flags = this->component_flags;
-    copy.component_length = this->component_length;
-    copy.components = new ECS::Component[ECS::NUM_COMPONENT_TYPES];
-    for (int i = 0; i < this->component_length; ++i)
+    ECS::Chunk *chunk = this->get_chunk(chunk_position);
+    if (!chunk->uniform_dirty)
     {
-        copy.components[i] = this->components[i];
+        return;
+    }
+    chunk->uniform_dirty = false;
+    int width = std::min(ECS::CHUNK_SIZE, this->dimensions.x - chunk_position.x * ECS::CHUNK_SIZE);
+    int height = std::min(ECS::CHUNK_SIZE, this->dimensions.y - chunk_position.y * ECS::CHUNK_SIZE);
+    for (int layer = 0; layer < ECS::NUM_TILE_LAYERS; ++layer)
+    {
+        uint16_t tile = chunk->cells[0].tiles[layer];
+        bool uniform = true;
+        for (int y = 0; y < height && uniform; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                if (chunk->cells[y * ECS::CHUNK_SIZE + x].tiles[layer] != tile)
+                {
+                    uniform = false;
+                    break;
+                }
+            }
+        }
+        if (!uniform)
+        {
+            chunk->uniform_prototype_ids[layer] = ECS::MIXED_LAYER;
+        }
+        else
+        {
+            chunk->uniform_prototype_ids[layer] = tile == 0 ? ECS::EMPTY_LAYER : tile - 1;
+        }
     }
-    return copy;
 }
 
 ECS::Map::Map() : mouse_data_cached(false), hovered_cell_cached(false){};
@@ -72,6 +992,42 @@ void ECS::Map::recalculate_mouse_positions()
     this->mouse_data_cached = true;
 }
 
+void ECS::Map::place_tile(V2 grid_position, int prototype_id)
+{
+    assert(grid_position.x >= 0 &&
+           grid_position.x < static_cast<int>(this->dimensions.x) &&
+           grid_position.y >= 0 &&
+           grid_position.y < static_cast<int>(this->dimensions.y));
+    const ECS::Entity *prototype = ECS::get_prototype(prototype_id);
+    assert(prototype != nullptr);
+    this->grid.set_tile(grid_position, ECS::get_tile_layer(prototype), prototype_id);
+}
+
+void ECS::Map::fill_tiles(Rect area, int prototype_id, const unsigned char *mask)
+{
+    // Clamp to the map instead of asserting per cell so a drag that runs off
+    // the edge still fills what it can.
+    int start_x = std::max(area.x, 0);
+    int start_y = std::max(area.y, 0);
+    int end_x = std::min(area.x + area.w, this->dimensions.x);
+    int end_y = std::min(area.y + area.h, this->dimensions.y);
+    for (int y = start_y; y < end_y; ++y)
+    {
+        for (int x = start_x; x < end_x; ++x)
+        {
+            if (mask != nullptr)
+            {
+                int bit = (y - area.y) * area.w + (x - area.x);
+                if (!(mask[bit / 8] & (1 << (bit % 8))))
+                {
+                    continue;
+                }
+            }
+            this->place_tile({x, y}, prototype_id);
+        }
+    }
+}
+
 Rect ECS::Map::get_hovered_grid_cell()
 {
     if (!this->hovered_cell_cached)
@@ -110,133 +1066,323 @@ V2 ECS::Map::get_mouse_world_position()
 
 // Systems
 
-bool ECS::render_system(Entity *e)
+ECS::RenderCache::RenderCache() : camera({0, 0, -1, -1}), seen_tick(0){};
+
+Rect ECS::render_bounds(const ECS::PositionComponent *position_component, const ECS::RenderComponent *render_component)
 {
-    if ((e->component_flags & ECS::RENDER_SYSTEM_FLAGS) == ECS::RENDER_SYSTEM_FLAGS)
+    Rect clip = {};
+    if (render_component->has_clip)
     {
-        ECS::Component *render_ptr = e->get_component(ECS::Type::RENDER);
-        ECS::Component *position_ptr = e->get_component(ECS::Type::POSITION);
-        assert(render_ptr != nullptr && position_ptr != nullptr);
-        auto render_component = render_ptr->data.r;
-        auto position_component = position_ptr->data.p;
-        if (!render_component.has_clip)
-        {
-            render_component.clip = {};
-        }
-        Rect *camera = Window::get_camera();
-        Rect entity_rect = {
-            position_component.position.x,
-            position_component.position.y,
-            render_component.clip.w * render_component.scale,
-            render_component.clip.h * render_component.scale};
-        if (Physics::check_collision(camera, &entity_rect))
-        {
-            V2 render_position = {position_component.position.x - camera->x, position_component.position.y - camera->y};
-            Render::render_texture(
-                render_component.layer,
-                render_component.texture_index,
-                render_component.clip,
-                render_position,
-                nullptr,
-                render_component.scale,
-                render_component.z_index);
-            return true;
-        }
+        clip = render_component->clip;
     }
-    return false;
+    return {
+        position_component->position.x,
+        position_component->position.y,
+        clip.w * render_component->scale,
+        clip.h * render_component->scale};
 }
 
-void ECS::camera_system(Entity *e)
+bool ECS::render_system(const ECS::PositionComponent *position_component, const ECS::RenderComponent *render_component, const Rect *bounds)
 {
-    auto camera_ptr = e->get_component(ECS::Type::CAMERA);
-    auto position_ptr = e->get_component(ECS::Type::POSITION);
-    if (camera_ptr != nullptr && position_ptr != nullptr)
+    Rect *camera = Window::get_camera();
+    Rect entity_rect = *bounds;
+    if (Physics::check_collision(camera, &entity_rect))
     {
-        auto position = position_ptr->data.p.position;
-        Window::set_camera_position(position);
+        Rect clip = {};
+        if (render_component->has_clip)
+        {
+            clip = render_component->clip;
+        }
+        V2 render_position = {position_component->position.x - camera->x, position_component->position.y - camera->y};
+        Render::render_texture(
+            render_component->layer,
+            render_component->texture_index,
+            clip,
+            render_position,
+            nullptr,
+            render_component->scale,
+            render_component->z_index);
+        return true;
     }
+    return false;
 }
 
-void ECS::input_system(ECS::Map *map, Entity *e, double ts)
+int ECS::render_storage(ECS::Storage *storage, ECS::RenderCache *cache, const ECS::SpatialHash *index)
 {
-    double speed = 500;
-    auto player_input_ptr = e->get_component(ECS::Type::PLAYER_INPUT);
-    auto position_ptr = e->get_component(ECS::Type::POSITION);
-    if (player_input_ptr != nullptr && position_ptr != nullptr)
+    if (static_cast<int>(cache->bounds.size()) < storage->slot_count())
     {
-        auto w_pressed = Input::is_input_active(Input::Event::W_KEY_DOWN);
-        auto a_pressed = Input::is_input_active(Input::Event::A_KEY_DOWN);
-        auto s_pressed = Input::is_input_active(Input::Event::S_KEY_DOWN);
-        auto d_pressed = Input::is_input_active(Input::Event::D_KEY_DOWN);
-        auto position = &position_ptr->data.p.position;
-        int vel = speed * ts;
-        if (w_pressed)
-        {
-            position->y -= vel;
-        }
-        if (s_pressed)
+        cache->bounds.resize(storage->slot_count());
+        cache->visible_flags.resize(storage->slot_count(), 0);
+    }
+    Rect camera = *Window::get_camera();
+    bool camera_moved = camera.x != cache->camera.x || camera.y != cache->camera.y ||
+                        camera.w != cache->camera.w || camera.h != cache->camera.h;
+    cache->camera = camera;
+    auto view = storage->view<const ECS::PositionComponent, const ECS::RenderComponent>();
+    if (!camera_moved || index != nullptr)
+    {
+        view.changed<ECS::PositionComponent, ECS::RenderComponent>(cache->seen_tick);
+    }
+    view.each_with_index([cache, &camera](int index, const ECS::PositionComponent &position, const ECS::RenderComponent &render) {
+        cache->bounds[index] = ECS::render_bounds(&position, &render);
+        bool visible = Physics::check_collision(&camera, &cache->bounds[index]);
+        if (visible && !cache->visible_flags[index])
         {
-            position->y += vel;
+            cache->visible.push_back(index);
         }
-        if (a_pressed)
+        cache->visible_flags[index] = visible;
+    });
+    cache->seen_tick = storage->bump_tick();
+    if (camera_moved && index != nullptr)
+    {
+        // Rebuild the set from whatever the index has under the new camera
+        // instead of re-testing every entity.
+        for (int visible_index : cache->visible)
         {
-            position->x -= vel;
+            cache->visible_flags[visible_index] = 0;
         }
-        if (d_pressed)
+        cache->visible.clear();
+        cache->candidates.clear();
+        index->query_indices(camera, &cache->candidates);
+        for (int candidate : cache->candidates)
         {
-            position->x += vel;
+            if (candidate < static_cast<int>(cache->visible_flags.size()) && !cache->visible_flags[candidate] &&
+                Physics::check_collision(&camera, &cache->bounds[candidate]))
+            {
+                cache->visible_flags[candidate] = 1;
+                cache->visible.push_back(candidate);
+            }
         }
+    }
 
-        V2 *window = Window::get_window();
-        Rect *camera = Window::get_camera();
-        V2 window_dimensions_with_camera_zoom = {
-            window->x - (window->x - camera->w),
-            window->y - (window->y - camera->h)};
-
-        if (position->x < 0)
-        {
-            position->x = 0;
-        }
-        if (position->x + window_dimensions_with_camera_zoom.x > map->pixel_dimensions.x)
+    // Drop anything that went off camera, was destroyed or lost its render
+    // data since it was added.
+    int rendered = 0;
+    int kept = 0;
+    for (int index : cache->visible)
+    {
+        if (!cache->visible_flags[index])
         {
-            position->x = map->pixel_dimensions.x - window_dimensions_with_camera_zoom.x;
+            continue;
         }
-        if (position->y < 0)
+        ECS::EntityHandle handle = storage->get_handle(index);
+        const ECS::PositionComponent *position = storage->read<ECS::PositionComponent>(handle);
+        const ECS::RenderComponent *render = storage->read<ECS::RenderComponent>(handle);
+        if (position == nullptr || render == nullptr)
         {
-            position->y = 0;
+            cache->visible_flags[index] = 0;
+            continue;
         }
-        if (position->y + window_dimensions_with_camera_zoom.y > map->pixel_dimensions.y)
+        cache->visible[kept++] = index;
+        if (ECS::render_system(position, render, &cache->bounds[index]))
         {
-            position->y = map->pixel_dimensions.y - window_dimensions_with_camera_zoom.y;
+            ++rendered;
         }
-        if (window_dimensions_with_camera_zoom.x > map->pixel_dimensions.x)
+    }
+    cache->visible.resize(kept);
+    return rendered;
+}
+
+static const ECS::RenderComponent *tile_render(int prototype_id)
+{
+    return ECS::get_prototype(prototype_id)->get<ECS::RenderComponent>();
+}
+
+static void bake_tile(const ECS::RenderComponent *render, V2 position)
+{
+    // Everything but the position comes from the blueprint.
+    Rect clip = {};
+    if (render->has_clip)
+    {
+        clip = render->clip;
+    }
+    Render::bake_texture(render->texture_index, clip, position, render->scale, render->z_index);
+}
+
+// extent is how much of the chunk lies on the map.
+static void bake_chunk(ECS::Map *map, const ECS::Chunk *chunk, int key, int overhang, V2 extent)
+{
+    int chunk_pixels = ECS::CHUNK_SIZE * map->cell_size;
+    Render::begin_bake(key, chunk->version, {chunk_pixels + overhang, chunk_pixels + overhang});
+    // When every layer is one blueprint or empty (a freshly generated field of
+    // grass, say), the blueprints are looked up once and no cell is read.
+    // Tiles go out in the same order as the general case below.
+    const ECS::RenderComponent *uniform_renders[ECS::NUM_TILE_LAYERS];
+    bool uniform = true;
+    for (int layer = 0; layer < ECS::NUM_TILE_LAYERS; ++layer)
+    {
+        int prototype_id = chunk->uniform_prototype_ids[layer];
+        uniform = uniform && prototype_id != ECS::MIXED_LAYER;
+        uniform_renders[layer] = prototype_id >= 0 ? tile_render(prototype_id) : nullptr;
+    }
+    if (uniform)
+    {
+        for (int y = 0; y < extent.y; ++y)
         {
-            position->x = -((window_dimensions_with_camera_zoom.x - map->pixel_dimensions.x) / 2);
+            for (int x = 0; x < extent.x; ++x)
+            {
+                V2 position = {x * map->cell_size, y * map->cell_size};
+                for (const ECS::RenderComponent *render : uniform_renders)
+                {
+                    if (render != nullptr)
+                    {
+                        bake_tile(render, position);
+                    }
+                }
+            }
         }
-        if (window_dimensions_with_camera_zoom.y > map->pixel_dimensions.y)
+        Render::end_bake();
+        return;
+    }
+    for (int y = 0; y < ECS::CHUNK_SIZE; ++y)
+    {
+        for (int x = 0; x < ECS::CHUNK_SIZE; ++x)
         {
-            position->y = -((window_dimensions_with_camera_zoom.y - map->pixel_dimensions.y) / 2);
+            const ECS::Cell *cell = &chunk->cells[y * ECS::CHUNK_SIZE + x];
+            if (!(cell->occupancy & ECS::CELL_HAS_TILE))
+            {
+                continue;
+            }
+            V2 position = {x * map->cell_size, y * map->cell_size};
+            for (int layer = 0; layer < ECS::NUM_TILE_LAYERS; ++layer)
+            {
+                if (cell->tiles[layer] == 0)
+                {
+                    continue;
+                }
+                const ECS::RenderComponent *render = tile_render(cell->tiles[layer] - 1);
+                if (render != nullptr)
+                {
+                    bake_tile(render, position);
+                }
+            }
         }
     }
+    Render::end_bake();
 }
 
-void ECS::process_map(ECS::Map *m, double ts)
+int ECS::render_tiles(ECS::Map *map)
 {
-    int tiles_rendered = 0;
-    for (int i = 0; i < m->dimensions.x; ++i)
+    // Tiles don't move, so each chunk is baked into one texture and drawn with
+    // a single blit until something in it changes. Tiles can be drawn bigger
+    // than a cell and hang over to the right and down, so chunk textures are
+    // padded by the overhang and the visible range starts a little early.
+    Rect *camera = Window::get_camera();
+    int overhang = std::max(max_prototype_render_size - map->cell_size, 0);
+    int start_x = std::max((camera->x - overhang) / map->cell_size, 0);
+    int start_y = std::max((camera->y - overhang) / map->cell_size, 0);
+    int end_x = std::min((camera->x + camera->w) / map->cell_size + 1, map->grid.dimensions.x);
+    int end_y = std::min((camera->y + camera->h) / map->cell_size + 1, map->grid.dimensions.y);
+    // Keep every chunk a camera this size can touch, plus a ring around it so
+    // panning back and forth doesn't rebake. Sized from the camera rather than
+    // the chunks on screen so it doesn't shrink at the map's edges.
+    int chunk_pixels = ECS::CHUNK_SIZE * map->cell_size;
+    int chunk_columns = (camera->w + overhang + chunk_pixels - 1) / chunk_pixels + 1;
+    int chunk_rows = (camera->h + overhang + chunk_pixels - 1) / chunk_pixels + 1;
+    Render::set_cache_budget((chunk_columns + 2) * (chunk_rows + 2));
+    if (start_x >= end_x || start_y >= end_y)
+    {
+        return 0;
+    }
+    for (int chunk_y = start_y / ECS::CHUNK_SIZE; chunk_y <= (end_y - 1) / ECS::CHUNK_SIZE; ++chunk_y)
     {
-        for (int j = 0; j < m->dimensions.y; ++j)
+        for (int chunk_x = start_x / ECS::CHUNK_SIZE; chunk_x <= (end_x - 1) / ECS::CHUNK_SIZE; ++chunk_x)
         {
-            ECS::Cell *cell = &m->grid[i][j];
-            if (!cell->tile.empty)
+            const ECS::Chunk *chunk = map->grid.get_chunk({chunk_x, chunk_y});
+            if (chunk->tile_count == 0)
             {
-                if (ECS::render_system(&cell->tile.tile_entity))
-                {
-                    ++tiles_rendered;
-                }
+                continue;
+            }
+            int key = chunk_y * map->grid.chunk_dimensions.x + chunk_x;
+            if (!Render::is_cached(key, chunk->version))
+            {
+                map->grid.refresh_chunk({chunk_x, chunk_y});
+                V2 extent = {
+                    std::min(ECS::CHUNK_SIZE, map->grid.dimensions.x - chunk_x * ECS::CHUNK_SIZE),
+                    std::min(ECS::CHUNK_SIZE, map->grid.dimensions.y - chunk_y * ECS::CHUNK_SIZE)};
+                bake_chunk(map, chunk, key, overhang, extent);
             }
+            V2 render_position = {
+                chunk_x * ECS::CHUNK_SIZE * map->cell_size - camera->x,
+                chunk_y * ECS::CHUNK_SIZE * map->cell_size - camera->y};
+            Render::render_cached_texture(Render::Layer::WORLD_LAYER, key, render_position, Render::Z_Index::TILE_BASE_LAYER);
         }
     }
+    // Chunks are drawn whole, but only the tiles on camera count as rendered.
+    Rect on_camera = {
+        camera->x / map->cell_size,
+        camera->y / map->cell_size,
+        (camera->x + camera->w - 1) / map->cell_size - camera->x / map->cell_size + 1,
+        (camera->y + camera->h - 1) / map->cell_size - camera->y / map->cell_size + 1};
+    return map->grid.count_tiles(on_camera);
+}
+
+void ECS::camera_system(ECS::PositionComponent *position_component)
+{
+    Window::set_camera_position(position_component->position);
+}
+
+void ECS::input_system(ECS::Map *map, ECS::PositionComponent *position_component, double ts)
+{
+    double speed = 500;
+    auto w_pressed = Input::is_input_active(Input::Event::W_KEY_DOWN);
+    auto a_pressed = Input::is_input_active(Input::Event::A_KEY_DOWN);
+    auto s_pressed = Input::is_input_active(Input::Event::S_KEY_DOWN);
+    auto d_pressed = Input::is_input_active(Input::Event::D_KEY_DOWN);
+    auto position = &position_component->position;
+    int vel = speed * ts;
+    if (w_pressed)
+    {
+        position->y -= vel;
+    }
+    if (s_pressed)
+    {
+        position->y += vel;
+    }
+    if (a_pressed)
+    {
+        position->x -= vel;
+    }
+    if (d_pressed)
+    {
+        position->x += vel;
+    }
+
+    V2 *window = Window::get_window();
+    Rect *camera = Window::get_camera();
+    V2 window_dimensions_with_camera_zoom = {
+        window->x - (window->x - camera->w),
+        window->y - (window->y - camera->h)};
+
+    if (position->x < 0)
+    {
+        position->x = 0;
+    }
+    if (position->x + window_dimensions_with_camera_zoom.x > map->pixel_dimensions.x)
+    {
+        position->x = map->pixel_dimensions.x - window_dimensions_with_camera_zoom.x;
+    }
+    if (position->y < 0)
+    {
+        position->y = 0;
+    }
+    if (position->y + window_dimensions_with_camera_zoom.y > map->pixel_dimensions.y)
+    {
+        position->y = map->pixel_dimensions.y - window_dimensions_with_camera_zoom.y;
+    }
+    if (window_dimensions_with_camera_zoom.x > map->pixel_dimensions.x)
+    {
+        position->x = -((window_dimensions_with_camera_zoom.x - map->pixel_dimensions.x) / 2);
+    }
+    if (window_dimensions_with_camera_zoom.y > map->pixel_dimensions.y)
+    {
+        position->y = -((window_dimensions_with_camera_zoom.y - map->pixel_dimensions.y) / 2);
+    }
+}
+
+void ECS::process_map(ECS::Map *m, double ts)
+{
+    int tiles_rendered = ECS::render_tiles(m);
     {
         // DEBUG
         MBus::Message debug;
@@ -246,44 +1392,45 @@ void ECS::process_map(ECS::Map *m, double ts)
     }
 }
 
-ECS::Manager::Manager() : player_entity_index(-1){};
+ECS::Manager::Manager() : player_entity(ECS::NULL_ENTITY){};
 
 void ECS::Manager::update_player(double ts)
 {
-    if (this->player_entity_index == -1)
+    if (!this->entities.is_alive(this->player_entity))
     {
-        for (unsigned int i = 0; i < this->entities.size(); ++i)
+        this->player_entity = ECS::NULL_ENTITY;
+        for (ECS::Archetype &archetype : this->entities.archetypes)
         {
-            Entity *e = &this->entities[i];
-            auto input_component_ptr = e->get_component(ECS::Type::PLAYER_INPUT);
-            auto camera_component_ptr = e->get_component(ECS::Type::CAMERA);
-            if (input_component_ptr != nullptr && camera_component_ptr != nullptr)
+            if ((archetype.component_flags & ECS::PLAYER_SYSTEM_FLAGS) == ECS::PLAYER_SYSTEM_FLAGS && archetype.length > 0)
             {
-                this->player_entity_index = i;
+                this->player_entity = this->entities.get_handle(archetype.entity_indices[0]);
                 break;
             }
         }
-        if (this->player_entity_index == -1)
+        if (this->player_entity == ECS::NULL_ENTITY)
         {
             printf("WARNING: Could not find player entity\n");
             return;
         }
     }
-    ECS::input_system(&this->map, &this->entities[this->player_entity_index], ts);
-    ECS::camera_system(&this->entities[this->player_entity_index]);
+    auto position_component = this->entities.get<ECS::PositionComponent>(this->player_entity);
+    ECS::input_system(&this->map, position_component, ts);
+    ECS::camera_system(position_component);
 }
 
-void ECS::Manager::update(double ts)
+static void map_update_system(ECS::Manager *manager, double ts)
 {
-    int entities_rendered = 0;
-    this->map.update(ts);
-    for (Entity &e : this->entities)
-    {
-        if (ECS::render_system(&e))
-        {
-            ++entities_rendered;
-        }
-    }
+    manager->map.update(ts);
+}
+
+static void player_update_system(ECS::Manager *manager, double ts)
+{
+    manager->update_player(ts);
+}
+
+static void entity_render_system(ECS::Manager *manager, double ts)
+{
+    int entities_rendered = ECS::render_storage(&manager->entities, &manager->entity_render_cache, &manager->entity_index);
     {
         // DEBUG
         MBus::Message debug;
@@ -292,10 +1439,46 @@ void ECS::Manager::update(double ts)
         MBus::send_debug_message(&debug);
 
         debug.type = MBus::ENTITIES_PROCESSED;
-        debug.data.er.num = this->entities.size();
+        debug.data.er.num = manager->entities.size();
         MBus::send_debug_message(&debug);
     }
-};
+}
+
+static void spatial_index_system(ECS::Manager *manager, double ts)
+{
+    manager->entity_index.update(&manager->entities);
+}
+
+static void tile_render_system(ECS::Manager *manager, double ts)
+{
+    ECS::process_map(&manager->map, ts);
+}
+
+void ECS::add_core_systems(ECS::Scheduler *scheduler)
+{
+    scheduler->add_system({"map_update", map_update_system, 0, ECS::MAP_RESOURCE, false});
+    scheduler->add_system({"player_update",
+                           player_update_system,
+                           ECS::PLAYER_SYSTEM_FLAGS | ECS::INPUT_RESOURCE | ECS::MAP_RESOURCE | ECS::STORAGE_TICK_RESOURCE,
+                           ECS::POSITION_FLAG | ECS::CAMERA_RESOURCE,
+                           false});
+    scheduler->add_system({"spatial_index",
+                           spatial_index_system,
+                           ECS::RENDER_SYSTEM_FLAGS,
+                           ECS::SPATIAL_INDEX_RESOURCE | ECS::STORAGE_TICK_RESOURCE,
+                           false});
+    scheduler->add_system({"entity_render",
+                           entity_render_system,
+                           ECS::RENDER_SYSTEM_FLAGS | ECS::CAMERA_RESOURCE | ECS::SPATIAL_INDEX_RESOURCE,
+                           ECS::RENDER_RESOURCE | ECS::DEBUG_BUS_RESOURCE | ECS::STORAGE_TICK_RESOURCE,
+                           false});
+    // Writes the map because baking refreshes the chunks' uniform metadata.
+    scheduler->add_system({"tile_render",
+                           tile_render_system,
+                           ECS::RENDER_SYSTEM_FLAGS | ECS::CAMERA_RESOURCE,
+                           ECS::RENDER_RESOURCE | ECS::DEBUG_BUS_RESOURCE | ECS::MAP_RESOURCE,
+                           false});
+}
 
 void ECS::Manager::process_messages()
 {
@@ -305,54 +1488,134 @@ void ECS::Manager::process_messages()
         MBus::Message message = queue.queue[i];
         if (message.type == MBus::CREATE_ENTITY)
         {
-            assert(message.data.ce.blueprint != nullptr);
-            Entity entity = message.data.ce.blueprint->make_deep_copy();
+            assert(message.data.ce.blueprint != nullptr && message.data.ce.blueprint->prototype_id != -1);
             Component position_component;
             position_component.type = POSITION;
             position_component.data.p = {message.data.ce.grid_position.x * this->map.cell_size, message.data.ce.grid_position.y * this->map.cell_size};
-            entity.add_component(&position_component);
-            this->map.grid[message.data.ce.grid_position.x][message.data.ce.grid_position.y].has_entity = true;
-            this->map.grid[message.data.ce.grid_position.x][message.data.ce.grid_position.y].entity_id = this->entities.size();
-            this->entities.push_back(entity);
+            this->map.grid.set_entity(
+                message.data.ce.grid_position,
+                this->entities.create_instance(message.data.ce.blueprint->prototype_id, &position_component, 1));
+        }
+        else if (message.type == MBus::DESTROY_ENTITY)
+        {
+            this->destroy_entity(message.data.de.entity);
         }
         else if (message.type == MBus::CREATE_TILE)
         {
-            V2 grid_position = message.data.ct.grid_position;
-            assert(grid_position.x >= 0 &&
-                   grid_position.x < static_cast<int>(this->map.dimensions.x) &&
-                   grid_position.y >= 0 &&
-                   grid_position.y < static_cast<int>(this->map.dimensions.y));
-            assert(message.data.ct.blueprint != nullptr);
-            Entity tile_entity = message.data.ct.blueprint->make_deep_copy();
-            Component position_component;
-            position_component.type = ECS::POSITION;
-            position_component.data.p.position = {
-                grid_position.x * this->map.cell_size,
-                grid_position.y * this->map.cell_size};
-            tile_entity.add_component(&position_component);
-            this->map.grid[grid_position.x][grid_position.y].tile.empty = false;
-            this->map.grid[grid_position.x][grid_position.y].tile.tile_entity = tile_entity;
+            assert(message.data.ct.blueprint != nullptr && message.data.ct.blueprint->prototype_id != -1);
+            this->map.place_tile(message.data.ct.grid_position, message.data.ct.blueprint->prototype_id);
+        }
+        else if (message.type == MBus::FILL_TILE_RECT)
+        {
+            assert(message.data.ftr.blueprint != nullptr && message.data.ftr.blueprint->prototype_id != -1);
+            this->map.fill_tiles(message.data.ftr.area, message.data.ftr.blueprint->prototype_id, nullptr);
+        }
+        else if (message.type == MBus::FILL_TILE_MASK)
+        {
+            assert(message.data.ftm.blueprint != nullptr && message.data.ftm.blueprint->prototype_id != -1);
+            this->map.fill_tiles(
+                message.data.ftm.area,
+                message.data.ftm.blueprint->prototype_id,
+                MBus::get_ecs_payload(message.data.ftm.mask_offset));
         }
         else if (message.type == MBus::HANDLE_CAMERA_RESIZE_FOR_PLAYER)
         {
-            if (this->player_entity_index != -1)
+            auto player_position_ptr = this->entities.get<ECS::PositionComponent>(this->player_entity);
+            if (player_position_ptr != nullptr)
             {
-                Entity *player = &this->entities[this->player_entity_index];
-                auto player_position_ptr = player->get_component(ECS::Type::POSITION);
-                if (player_position_ptr != nullptr)
-                {
-                    V2 old_camera_dimensions = message.data.hcrfp.old_camera_dimensions;
-                    V2 new_camera_dimensions = message.data.hcrfp.new_camera_dimensions;
-                    V2 *current_player_position = &player_position_ptr->data.p.position;
-                    *current_player_position = {
-                        current_player_position->x + (old_camera_dimensions.x - new_camera_dimensions.x) / 2,
-                        current_player_position->y + (old_camera_dimensions.y - new_camera_dimensions.y) / 2};
-                }
+                V2 old_camera_dimensions = message.data.hcrfp.old_camera_dimensions;
+                V2 new_camera_dimensions = message.data.hcrfp.new_camera_dimensions;
+                V2 *current_player_position = &player_position_ptr->position;
+                *current_player_position = {
+                    current_player_position->x + (old_camera_dimensions.x - new_camera_dimensions.x) / 2,
+                    current_player_position->y + (old_camera_dimensions.y - new_camera_dimensions.y) / 2};
             }
         }
     }
 }
 
+void ECS::Manager::destroy_entity(ECS::EntityHandle handle)
+{
+    if (!this->entities.is_alive(handle))
+    {
+        printf("WARNING: DESTROY_ENTITY received a stale handle %d:%d\n", handle.index, handle.generation);
+        return;
+    }
+    V2 grid_position;
+    if (this->get_entity_cell(handle, &grid_position))
+    {
+        this->map.grid.clear_entity(grid_position);
+    }
+    this->entities.destroy_entity(handle);
+}
+
+bool ECS::Manager::get_entity_cell(ECS::EntityHandle handle, V2 *grid_position)
+{
+    auto position_component = this->entities.read<ECS::PositionComponent>(handle);
+    if (position_component == nullptr)
+    {
+        return false;
+    }
+    V2 position = {
+        position_component->position.x / this->map.cell_size,
+        position_component->position.y / this->map.cell_size};
+    if (position.x < 0 || position.x >= this->map.dimensions.x ||
+        position.y < 0 || position.y >= this->map.dimensions.y)
+    {
+        return false;
+    }
+    ECS::EntityHandle cell_entity;
+    if (!this->map.grid.get_entity(position, &cell_entity) || cell_entity != handle)
+    {
+        return false;
+    }
+    *grid_position = position;
+    return true;
+}
+
+bool ECS::Manager::get_entity_at(V2 world_position, ECS::EntityHandle *handle)
+{
+    std::vector<ECS::EntityHandle> handles;
+    this->entity_index.query_point(&this->entities, world_position, &handles);
+    int top_z_index = 0;
+    bool found = false;
+    for (ECS::EntityHandle candidate : handles)
+    {
+        const ECS::RenderComponent *render = this->entities.read<ECS::RenderComponent>(candidate);
+        if (render == nullptr)
+        {
+            continue;
+        }
+        if (!found || render->z_index >= top_z_index)
+        {
+            top_z_index = render->z_index;
+            *handle = candidate;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool ECS::Manager::get_cell_entity(V2 grid_position, ECS::EntityHandle *handle)
+{
+    assert(grid_position.x >= 0 && grid_position.x < this->map.dimensions.x &&
+           grid_position.y >= 0 && grid_position.y < this->map.dimensions.y);
+    ECS::EntityHandle cell_entity;
+    if (!this->map.grid.get_entity(grid_position, &cell_entity))
+    {
+        return false;
+    }
+    if (!this->entities.is_alive(cell_entity))
+    {
+        // The entity was destroyed without going through DESTROY_ENTITY.
+        printf("WARNING: Cell %d %d held a stale entity handle %d:%d\n", grid_position.x, grid_position.y, cell_entity.index, cell_entity.generation);
+        this->map.grid.clear_entity(grid_position);
+        return false;
+    }
+    *handle = cell_entity;
+    return true;
+}
+
 picojson::object ECS::jsonize_component(Type type, Component *component)
 {
     picojson::object component_object;
@@ -401,7 +1664,7 @@ picojson::object ECS::jsonize_component(Type type, Component *component)
             component_object["draw_layer"] = picojson::value("WORLD_LAYER");
         }
         component_object["scale"] = picojson::value((double)component->data.r.scale);
-        component_object["texture_key"] = picojson::value(component->strings[component->data.r.texture_key_strings_index]);
+        component_object["texture_key"] = picojson::value(Atoms::resolve(component->data.r.texture_key));
         if (component->data.r.z_index == Render::Z_Index::TILE_BASE_LAYER)
         {
             component_object["z_index"] = picojson::value("TILE_BASE_LAYER");
@@ -431,8 +1694,8 @@ picojson::object ECS::jsonize_component(Type type, Component *component)
     case ECS::Type::INFO:
     {
         component_object["type"] = picojson::value("INFO");
-        component_object["name"] = picojson::value(component->strings[component->data.i.name_string_index]);
-        component_object["description"] = picojson::value(component->strings[component->data.i.description_string_index]);
+        component_object["name"] = picojson::value(Atoms::resolve(component->data.i.name));
+        component_object["description"] = picojson::value(Atoms::resolve(component->data.i.description));
         break;
     }
     }
@@ -544,8 +1807,7 @@ ECS::ComponentizeJsonResult ECS::componentize_json(picojson::object *object)
                 result.component.data.r.z_index = Render::Z_Index::ENTITY_LAYER;
             }
             result.component.data.r.scale = scale;
-            result.component.strings.push_back(texture_key);
-            result.component.data.r.texture_key_strings_index = result.component.strings.size() - 1;
+            result.component.data.r.texture_key = Atoms::intern(texture_key);
             result.component.data.r.texture_index = Assets::get_texture_index(texture_key);
             result.success = true;
         }
@@ -562,10 +1824,8 @@ ECS::ComponentizeJsonResult ECS::componentize_json(picojson::object *object)
         {
             std::string name_string = info_comp_obj["name"].get<std::string>();
             std::string description_string = info_comp_obj["description"].get<std::string>();
-            result.component.strings.push_back(name_string);
-            result.component.data.i.name_string_index = result.component.strings.size() - 1;
-            result.component.strings.push_back(description_string);
-            result.component.data.i.description_string_index = result.component.strings.size() - 1;
+            result.component.data.i.name = Atoms::intern(name_string);
+            result.component.data.i.description = Atoms::intern(description_string);
             result.success = true;
         }
         else
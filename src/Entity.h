@@ -3,9 +3,14 @@
 
 #include "GameTypes.h"
 #include "Render.h"
+#include "Atoms.h"
 #include "json/picojson.h"
 #include <vector>
+#include <string>
 #include <unordered_map>
+#include <type_traits>
+#include <algorithm>
+#include <stdint.h>
 
 namespace ECS
 {
@@ -25,7 +30,10 @@ enum Type
 
 const static int RENDER_FLAG = 1 << ECS::RENDER;
 const static int POSITION_FLAG = 1 << ECS::POSITION;
+const static int CAMERA_FLAG = 1 << ECS::CAMERA;
+const static int PLAYER_INPUT_FLAG = 1 << ECS::PLAYER_INPUT;
 const static int RENDER_SYSTEM_FLAGS = RENDER_FLAG | POSITION_FLAG;
+const static int PLAYER_SYSTEM_FLAGS = POSITION_FLAG | CAMERA_FLAG | PLAYER_INPUT_FLAG;
 
 struct PositionComponent
 {
@@ -38,7 +46,7 @@ struct RenderComponent
     Render::Layer layer;
     int texture_index;
     // ** For Serialization **
-    int texture_key_strings_index;
+    Atoms::Atom texture_key;
     // **
     int scale;
     int z_index;
@@ -60,17 +68,15 @@ struct BuildCostComponent
 
 struct InfoComponent
 {
-    int name_string_index;
-    int description_string_index;
+    Atoms::Atom name;
+    Atoms::Atom description;
 };
 
+// Plain data: anything string-like is interned through Atoms, so components
+// (and Entities) can be copied with memcpy.
 struct Component
 {
     ECS::Type type;
-    // Can't store strings in unions so each
-    // component has a strings array that a component
-    // can stuff string in and keep an index to each one.
-    std::vector<std::string> strings;
     union {
         PositionComponent p;
         RenderComponent r;
@@ -79,32 +85,627 @@ struct Component
         InfoComponent i;
     } data;
 };
+static_assert(std::is_trivially_copyable<ECS::Component>::value, "ECS::Component must stay plain data");
 
+int component_data_size(ECS::Type);
+
+// Maps a component data struct to its ECS::Type so lookups can be typed,
+// e.g. entity.get<ECS::PositionComponent>().
+template <typename T>
+struct ComponentType;
+template <>
+struct ComponentType<PositionComponent>
+{
+    const static ECS::Type type = ECS::POSITION;
+};
+template <>
+struct ComponentType<RenderComponent>
+{
+    const static ECS::Type type = ECS::RENDER;
+};
+template <>
+struct ComponentType<PositionAnimateComponent>
+{
+    const static ECS::Type type = ECS::POSITION_ANIMATE;
+};
+template <>
+struct ComponentType<BuildCostComponent>
+{
+    const static ECS::Type type = ECS::BUILD_COST;
+};
+template <>
+struct ComponentType<InfoComponent>
+{
+    const static ECS::Type type = ECS::INFO;
+};
+// Views take const component types for read-only access.
+template <typename T>
+struct ComponentType<const T> : ComponentType<T>
+{
+};
+
+// The component_flags bits an entity needs to have every one of Ts,
+// e.g. ComponentMask<PositionComponent, RenderComponent>::value.
+template <typename... Ts>
+struct ComponentMask;
+template <>
+struct ComponentMask<>
+{
+    const static int value = 0;
+};
+template <typename T, typename... Rest>
+struct ComponentMask<T, Rest...>
+{
+    const static int value = (1 << ECS::ComponentType<T>::type) | ECS::ComponentMask<Rest...>::value;
+};
+
+// An Entity is the "loose" form of an entity: blueprints, save files and
+// anything else that builds entities up one component at a time use it.
+// Once an entity lives in a Storage its components are split up by type.
 struct Entity
 {
     Entity();
-    ~Entity();
     void add_component(ECS::Component *);
-    ECS::Entity make_deep_copy() const;
     ECS::Component *get_component(ECS::Type);
-    ECS::Component *components;
+    const ECS::Component *get_component(ECS::Type) const;
+    template <typename T>
+    T *get();
+    template <typename T>
+    const T *get() const;
+    ECS::Component components[ECS::NUM_COMPONENT_TYPES];
+    // type -> index into components, -1 when the entity doesn't have it.
+    signed char component_slots[ECS::NUM_COMPONENT_TYPES];
     int component_flags;
     int component_length;
+    // Set on blueprints registered with register_prototype, -1 otherwise.
+    int prototype_id;
+};
+
+template <typename T>
+T *Entity::get()
+{
+    int slot = this->component_slots[ECS::ComponentType<T>::type];
+    return slot < 0 ? nullptr : reinterpret_cast<T *>(&this->components[slot].data);
+}
+
+template <typename T>
+const T *Entity::get() const
+{
+    int slot = this->component_slots[ECS::ComponentType<T>::type];
+    return slot < 0 ? nullptr : reinterpret_cast<const T *>(&this->components[slot].data);
+}
+
+// A handle stays valid until its entity is destroyed. Slots are recycled, so
+// the generation is bumped on destroy and any handle still pointing at the old
+// occupant of a slot can be told apart from the new one.
+struct EntityHandle
+{
+    int index;
+    int generation;
+};
+const static EntityHandle NULL_ENTITY = {-1, 0};
+bool operator==(const ECS::EntityHandle &, const ECS::EntityHandle &);
+bool operator!=(const ECS::EntityHandle &, const ECS::EntityHandle &);
+
+struct EntityLocation
+{
+    // -1 when the slot is on the free list.
+    int archetype_index;
+    int row;
+};
+
+// Prototypes are immutable blueprints shared by every entity placed from them.
+// Instances copy the prototype's component data into their rows and only
+// remember the prototype id, so placing one doesn't allocate.
+int register_prototype(ECS::Entity *);
+// Id of a registered prototype with the same components as the entity, or -1.
+int find_prototype(const ECS::Entity *);
+const ECS::Entity *get_prototype(int prototype_id);
+
+// Every entity with the same component_flags lives in the same Archetype.
+// Each component type in the signature gets its own tightly packed column
+// (row n of every column belongs to the slot entity_indices[n]) so systems
+// can stream over e.g. positions and render data without dragging anything
+// else through cache.
+//
+// Every write to a row stamps it with the owning Storage's change_tick in
+// change_ticks[type], and column_ticks[type] keeps the newest stamp in the
+// column so unchanged archetypes can be skipped without touching their rows.
+struct Archetype
+{
+    Archetype(int component_flags);
+    void *get_column(ECS::Type);
+    template <typename T>
+    T *get_column();
+    void mark_changed(ECS::Type, int begin, int end, unsigned int tick);
+    int component_flags;
+    int length;
+    std::vector<int> entity_indices;
+    std::vector<int> prototype_ids;
+    std::vector<unsigned char> columns[ECS::NUM_COMPONENT_TYPES];
+    std::vector<unsigned int> change_ticks[ECS::NUM_COMPONENT_TYPES];
+    unsigned int column_ticks[ECS::NUM_COMPONENT_TYPES];
 };
 
-struct Tile
+struct Storage;
+
+// A typed query over a Storage. each() visits every entity that has all of
+// Ts, one archetype at a time, with the columns resolved up front so the
+// inner loop only walks plain arrays:
+//   storage.view<const PositionComponent, RenderComponent>().each(
+//       [](const PositionComponent &p, RenderComponent &r) { ... });
+// Non-const Ts count as writes and stamp the rows they visit, so ask for
+// const access when a system only reads.
+template <typename... Ts>
+struct View
 {
-    ECS::Entity tile_entity;
-    bool empty;
+    View(ECS::Storage *);
+    // Only visit rows where one of Changed was written after `since` (a tick
+    // returned by Storage::bump_tick).
+    template <typename... Changed>
+    View &changed(unsigned int since);
+    template <typename F>
+    void each(F f);
+    // Same as each() but f also gets the entity's slot index first.
+    template <typename F>
+    void each_with_index(F f);
+    // f(length, Ts *...) once per matching archetype, for loops that want the
+    // raw columns. A changed() filter only skips whole archetypes here.
+    template <typename F>
+    void each_chunk(F f);
+    int count();
+    ECS::Storage *storage;
+    int changed_mask;
+    unsigned int changed_since;
+
+private:
+    bool matches(const ECS::Archetype *) const;
+    bool row_changed(const ECS::Archetype *, int row) const;
+    void touch_rows(ECS::Archetype *, int begin, int end);
+    template <typename F>
+    void each_row(ECS::Archetype *, F &f, Ts *... columns);
 };
 
+struct Storage
+{
+    Storage();
+    ECS::EntityHandle create_entity(const ECS::Entity &);
+    ECS::EntityHandle create_instance(int prototype_id, const ECS::Component *overrides, int override_count);
+    void destroy_entity(ECS::EntityHandle);
+    void replace_entity(ECS::EntityHandle, const ECS::Entity &);
+    void replace_instance(ECS::EntityHandle, int prototype_id, const ECS::Component *overrides, int override_count);
+    bool is_alive(ECS::EntityHandle) const;
+    ECS::EntityHandle get_handle(int index) const;
+    ECS::Entity make_entity(ECS::EntityHandle);
+    void *get_component(ECS::EntityHandle, ECS::Type);
+    const void *get_component(ECS::EntityHandle, ECS::Type) const;
+    template <typename T>
+    T *get(ECS::EntityHandle);
+    // get() without marking the component as changed.
+    template <typename T>
+    const T *read(ECS::EntityHandle) const;
+    template <typename... Ts>
+    ECS::View<Ts...> view();
+    // Returns the tick a consumer has now seen everything up to; later writes
+    // are stamped with a newer one. Scheduled systems that call this declare
+    // a write on ECS::STORAGE_TICK_RESOURCE.
+    unsigned int bump_tick();
+    int get_archetype_index(int component_flags);
+    int size() const;
+    int slot_count() const;
+    std::vector<ECS::Archetype> archetypes;
+    std::vector<ECS::EntityLocation> locations;
+    std::vector<int> generations;
+    std::vector<int> free_indices;
+    int live_count;
+    unsigned int change_tick;
+
+private:
+    int allocate_index();
+    ECS::EntityLocation insert_row(int index, int component_flags, int prototype_id, const ECS::Component *, int length);
+    void write_row(ECS::Archetype *, int row, int prototype_id, const ECS::Component *, int length);
+    void remove_row(ECS::EntityLocation);
+};
+
+template <typename T>
+T *Archetype::get_column()
+{
+    return static_cast<T *>(this->get_column(ECS::ComponentType<T>::type));
+}
+
+template <typename T>
+T *Storage::get(ECS::EntityHandle handle)
+{
+    return static_cast<T *>(this->get_component(handle, ECS::ComponentType<T>::type));
+}
+
+template <typename T>
+const T *Storage::read(ECS::EntityHandle handle) const
+{
+    return static_cast<const T *>(this->get_component(handle, ECS::ComponentType<T>::type));
+}
+
+template <typename... Ts>
+ECS::View<Ts...> Storage::view()
+{
+    return ECS::View<Ts...>(this);
+}
+
+template <typename T>
+void touch_column(ECS::Archetype *archetype, int begin, int end, unsigned int tick)
+{
+    if (!std::is_const<T>::value)
+    {
+        archetype->mark_changed(ECS::ComponentType<T>::type, begin, end, tick);
+    }
+}
+
+template <typename... Ts>
+View<Ts...>::View(ECS::Storage *storage) : storage(storage), changed_mask(0), changed_since(0){};
+
+template <typename... Ts>
+template <typename... Changed>
+View<Ts...> &View<Ts...>::changed(unsigned int since)
+{
+    this->changed_mask = ECS::ComponentMask<Changed...>::value;
+    this->changed_since = since;
+    return *this;
+}
+
+template <typename... Ts>
+bool View<Ts...>::matches(const ECS::Archetype *archetype) const
+{
+    const int mask = ECS::ComponentMask<Ts...>::value;
+    if ((archetype->component_flags & mask) != mask || archetype->length == 0)
+    {
+        return false;
+    }
+    if (this->changed_mask == 0)
+    {
+        return true;
+    }
+    for (int type = 0; type < ECS::NUM_COMPONENT_TYPES; ++type)
+    {
+        if ((this->changed_mask & (1 << type)) && (archetype->component_flags & (1 << type)) &&
+            archetype->column_ticks[type] > this->changed_since)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename... Ts>
+bool View<Ts...>::row_changed(const ECS::Archetype *archetype, int row) const
+{
+    for (int type = 0; type < ECS::NUM_COMPONENT_TYPES; ++type)
+    {
+        if ((this->changed_mask & (1 << type)) && (archetype->component_flags & (1 << type)) &&
+            archetype->change_ticks[type][row] > this->changed_since)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename... Ts>
+void View<Ts...>::touch_rows(ECS::Archetype *archetype, int begin, int end)
+{
+    int expand[] = {0, (ECS::touch_column<Ts>(archetype, begin, end, this->storage->change_tick), 0)...};
+    (void)expand;
+}
+
+template <typename... Ts>
+template <typename F>
+void View<Ts...>::each_chunk(F f)
+{
+    for (ECS::Archetype &archetype : this->storage->archetypes)
+    {
+        if (!this->matches(&archetype))
+        {
+            continue;
+        }
+        this->touch_rows(&archetype, 0, archetype.length);
+        f(archetype.length, archetype.get_column<Ts>()...);
+    }
+}
+
+template <typename... Ts>
+template <typename F>
+void View<Ts...>::each_with_index(F f)
+{
+    for (ECS::Archetype &archetype : this->storage->archetypes)
+    {
+        if (this->matches(&archetype))
+        {
+            this->each_row(&archetype, f, archetype.get_column<Ts>()...);
+        }
+    }
+}
+
+template <typename... Ts>
+template <typename F>
+void View<Ts...>::each(F f)
+{
+    this->each_with_index([&f](int, Ts &... components) { f(components...); });
+}
+
+template <typename... Ts>
+template <typename F>
+void View<Ts...>::each_row(ECS::Archetype *archetype, F &f, Ts *... columns)
+{
+    const int *entity_indices = archetype->entity_indices.data();
+    int length = archetype->length;
+    if (this->changed_mask == 0)
+    {
+        this->touch_rows(archetype, 0, length);
+        for (int i = 0; i < length; ++i)
+        {
+            f(entity_indices[i], columns[i]...);
+        }
+        return;
+    }
+    for (int i = 0; i < length; ++i)
+    {
+        if (this->row_changed(archetype, i))
+        {
+            this->touch_rows(archetype, i, i + 1);
+            f(entity_indices[i], columns[i]...);
+        }
+    }
+}
+
+template <typename... Ts>
+int View<Ts...>::count()
+{
+    int total = 0;
+    for (ECS::Archetype &archetype : this->storage->archetypes)
+    {
+        if (!this->matches(&archetype))
+        {
+            continue;
+        }
+        if (this->changed_mask == 0)
+        {
+            total += archetype.length;
+            continue;
+        }
+        for (int i = 0; i < archetype.length; ++i)
+        {
+            if (this->row_changed(&archetype, i))
+            {
+                ++total;
+            }
+        }
+    }
+    return total;
+}
+
+// World-space bounds of every renderable entity in a Storage, by slot index,
+// and the set of slots currently on camera. Only rows whose position or render
+// data changed since seen_tick are re-tested each frame, unless the camera
+// itself moved.
+struct RenderCache
+{
+    RenderCache();
+    std::vector<Rect> bounds;
+    std::vector<int> visible;
+    std::vector<unsigned char> visible_flags;
+    // SpatialHash results, kept between frames so camera moves don't
+    // allocate.
+    std::vector<int> candidates;
+    Rect camera;
+    unsigned int seen_tick;
+};
+
+// Buckets entities with a position by their world-space bounds (render size,
+// or a single pixel for entities that aren't drawn) so area queries only look
+// at nearby entities. update() re-buckets rows whose position or render data
+// changed. Destroyed entities are skipped by queries and cleared out when
+// their slot is reused.
+struct SpatialHash
+{
+    SpatialHash(int bucket_size = 256);
+    void update(ECS::Storage *);
+    void query_rect(const ECS::Storage *, Rect, std::vector<ECS::EntityHandle> *) const;
+    void query_radius(const ECS::Storage *, V2 center, int radius, std::vector<ECS::EntityHandle> *) const;
+    void query_point(const ECS::Storage *, V2 point, std::vector<ECS::EntityHandle> *) const;
+    // Slot indices of everything whose bounds overlap rect, live or not.
+    void query_indices(Rect, std::vector<int> *) const;
+    int size() const;
+    struct Record
+    {
+        ECS::EntityHandle handle;
+        Rect bounds;
+        bool indexed;
+    };
+    int bucket_size;
+    std::vector<Record> records;
+    std::unordered_map<int64_t, std::vector<int>> buckets;
+    unsigned int seen_tick;
+
+private:
+    void insert(int index, ECS::EntityHandle, Rect bounds);
+    void remove(int index);
+    Rect get_bucket_range(Rect bounds) const;
+    // Per-slot stamps so an entity spanning several buckets is only reported
+    // once per query.
+    mutable std::vector<unsigned int> query_marks;
+    mutable unsigned int query_stamp;
+};
+
+// Tiles are stored per layer, so a floor can sit on top of the ground
+// without replacing it.
+enum TileLayer
+{
+    BASE_TILE_LAYER,
+    FLOOR_TILE_LAYER,
+    OBJECT_TILE_LAYER,
+    NUM_TILE_LAYERS
+};
+
+// Picks the layer for a tile blueprint from its render z-index.
+ECS::TileLayer get_tile_layer(const ECS::Entity *prototype);
+
+const static uint8_t CELL_HAS_TILE = 1 << 0;
+const static uint8_t CELL_HAS_ENTITY = 1 << 1;
+
+// Tiles aren't entities: a cell only records which blueprint sits on each
+// layer. Everything else (texture, clip, scale) comes from the prototype when
+// the tile is drawn or saved, and the position comes from the cell itself.
 struct Cell
 {
-    Tile tile;
-    int entity_id;
-    bool has_entity;
+    // Prototype id + 1 for each layer, 0 when the layer is empty.
+    uint16_t tiles[ECS::NUM_TILE_LAYERS];
+    // CELL_HAS_* bits.
+    uint8_t occupancy;
+};
+static_assert(sizeof(ECS::Cell) <= 8, "ECS::Cell should stay a few bytes");
+
+const static int CHUNK_SIZE = 32;
+const static int MIXED_LAYER = -1;
+const static int EMPTY_LAYER = -2;
+
+// A CHUNK_SIZE x CHUNK_SIZE block of cells stored contiguously, row by row.
+struct Chunk
+{
+    Chunk();
+    ECS::Cell cells[ECS::CHUNK_SIZE * ECS::CHUNK_SIZE];
+    // Cells with at least one tile / with an entity.
+    int tile_count;
+    int entity_count;
+    // Per layer, the prototype every cell in the chunk uses, EMPTY_LAYER if no
+    // cell has a tile there, or MIXED_LAYER if the layer has gaps or mixed
+    // tiles. set_tile only marks it dirty; Grid::refresh_chunk recomputes it
+    // before it's read.
+    int uniform_prototype_ids[ECS::NUM_TILE_LAYERS];
+    bool uniform_dirty;
+    // Changes whenever a tile in the chunk changes. Versions are unique across
+    // every grid so a cached bake can't be mistaken for a different map's.
+    unsigned int version;
+};
+
+// One bit per cell, packed row by row into 64-bit words so region queries
+// touch 64 cells per load.
+struct Bitmap
+{
+    Bitmap();
+    void resize(V2 dimensions);
+    void set(V2 position);
+    void clear(V2 position);
+    bool test(V2 position) const;
+    const uint64_t *row(int y) const;
+    V2 dimensions;
+    int words_per_row;
+    std::vector<uint64_t> words;
+};
+
+// The map's cells, split into chunks laid out row by row. Reads go through
+// get_cell; writes go through the setters so the chunk metadata stays right.
+// Entities are sparse, so their handles live in a side table rather than in
+// every cell.
+struct Grid
+{
+    Grid();
+    void resize(V2 dimensions);
+    const ECS::Cell *get_cell(V2 grid_position) const;
+    void set_tile(V2 grid_position, ECS::TileLayer, int prototype_id);
+    void set_entity(V2 grid_position, ECS::EntityHandle);
+    void clear_entity(V2 grid_position);
+    bool get_entity(V2 grid_position, ECS::EntityHandle *) const;
+    ECS::Chunk *get_chunk(V2 chunk_position);
+    ECS::Chunk *get_cell_chunk(V2 grid_position);
+    void refresh_chunk(V2 chunk_position);
+    // f(V2 grid_position, const ECS::Cell *) for every cell on the map, one
+    // chunk at a time and row-major inside each chunk.
+    template <typename F>
+    void each_cell(F f) const;
+    // A cell is free when it has a tile and nothing standing on it. The area
+    // queries take a grid-space rect, clip it to the map and answer from the
+    // occupancy bitmaps a word at a time.
+    bool is_cell_free(V2 grid_position) const;
+    bool is_area_free(Rect area) const;
+    int count_free_cells(Rect area) const;
+    // Tiles on every layer in a grid-space rect.
+    int count_tiles(Rect area) const;
+    bool find_free_cell(Rect area, V2 *grid_position) const;
+    // f(V2 grid_position) for every free cell in the area, row-major.
+    template <typename F>
+    void each_free_cell(Rect area, F f) const;
+    V2 dimensions;
+    V2 chunk_dimensions;
+    std::vector<ECS::Chunk> chunks;
+    // y * dimensions.x + x -> entity standing on that cell.
+    std::unordered_map<int, ECS::EntityHandle> entities;
+    // Mirrors of the cell occupancy kept in step by the setters.
+    ECS::Bitmap layer_bits[ECS::NUM_TILE_LAYERS];
+    ECS::Bitmap tile_bits;
+    ECS::Bitmap entity_bits;
+
+private:
+    ECS::Cell *get_mutable_cell(V2 grid_position);
 };
 
+template <typename F>
+void Grid::each_cell(F f) const
+{
+    for (int chunk_y = 0; chunk_y < this->chunk_dimensions.y; ++chunk_y)
+    {
+        for (int chunk_x = 0; chunk_x < this->chunk_dimensions.x; ++chunk_x)
+        {
+            const ECS::Chunk *chunk = &this->chunks[chunk_y * this->chunk_dimensions.x + chunk_x];
+            int base_x = chunk_x * ECS::CHUNK_SIZE;
+            int base_y = chunk_y * ECS::CHUNK_SIZE;
+            int end_x = std::min(ECS::CHUNK_SIZE, this->dimensions.x - base_x);
+            int end_y = std::min(ECS::CHUNK_SIZE, this->dimensions.y - base_y);
+            for (int y = 0; y < end_y; ++y)
+            {
+                for (int x = 0; x < end_x; ++x)
+                {
+                    f(V2{base_x + x, base_y + y}, &chunk->cells[y * ECS::CHUNK_SIZE + x]);
+                }
+            }
+        }
+    }
+}
+
+// Bits [begin, end) of word_index, for end > word_index * 64.
+inline uint64_t bitmap_word_mask(int word_index, int begin, int end)
+{
+    int low = std::max(begin - word_index * 64, 0);
+    int high = std::min(end - word_index * 64, 64);
+    uint64_t mask = high == 64 ? ~uint64_t(0) : (uint64_t(1) << high) - 1;
+    return mask & (~uint64_t(0) << low);
+}
+
+template <typename F>
+void Grid::each_free_cell(Rect area, F f) const
+{
+    int begin_x = std::max(area.x, 0);
+    int begin_y = std::max(area.y, 0);
+    int end_x = std::min(area.x + area.w, this->dimensions.x);
+    int end_y = std::min(area.y + area.h, this->dimensions.y);
+    if (begin_x >= end_x)
+    {
+        return;
+    }
+    for (int y = begin_y; y < end_y; ++y)
+    {
+        const uint64_t *tiles = this->tile_bits.row(y);
+        const uint64_t *entities = this->entity_bits.row(y);
+        for (int w = begin_x / 64; w <= (end_x - 1) / 64; ++w)
+        {
+            uint64_t free = tiles[w] & ~entities[w] & ECS::bitmap_word_mask(w, begin_x, end_x);
+            while (free != 0)
+            {
+                f(V2{w * 64 + __builtin_ctzll(free), y});
+                free &= free - 1;
+            }
+        }
+    }
+}
+
 struct Map
 {
     Map();
@@ -112,12 +713,16 @@ struct Map
     V2 get_mouse_grid_position();
     V2 get_mouse_world_position();
     Rect get_hovered_grid_cell();
+    void place_tile(V2 grid_position, int prototype_id);
+    // Places prototype_id on every cell of a grid-space rect, or only on the
+    // cells set in mask (area.w * area.h bits, row by row) when it's non-null.
+    void fill_tiles(Rect area, int prototype_id, const unsigned char *mask);
     Rect hovered_grid_cell;
     V2 dimensions;
     V2 pixel_dimensions;
     V2 mouse_grid_position;
     V2 mouse_world_position;
-    ECS::Cell **grid;
+    ECS::Grid grid;
     int cell_size;
     bool mouse_data_cached;
     bool hovered_cell_cached;
@@ -126,9 +731,13 @@ private:
     void recalculate_mouse_positions();
 };
 
-void input_system(ECS::Map *, Entity *, double ts);
-bool render_system(Entity *);
-void camera_system(Entity *);
+void input_system(ECS::Map *, ECS::PositionComponent *, double ts);
+Rect render_bounds(const ECS::PositionComponent *, const ECS::RenderComponent *);
+bool render_system(const ECS::PositionComponent *, const ECS::RenderComponent *, const Rect *bounds);
+void camera_system(ECS::PositionComponent *);
+// With a SpatialHash, a camera move only re-tests the entities it returns.
+int render_storage(ECS::Storage *, ECS::RenderCache *, const ECS::SpatialHash * = nullptr);
+int render_tiles(ECS::Map *);
 
 picojson::object jsonize_component(Type, Component *);
 struct ComponentizeJsonResult
@@ -143,13 +752,27 @@ struct Manager
 {
     Manager();
     void update_player(double);
-    void update(double);
     void process_messages();
+    void destroy_entity(ECS::EntityHandle);
+    bool get_entity_cell(ECS::EntityHandle, V2 *grid_position);
+    bool get_cell_entity(V2 grid_position, ECS::EntityHandle *);
+    // Topmost entity drawn under a world-space point, e.g. the mouse.
+    bool get_entity_at(V2 world_position, ECS::EntityHandle *);
+    template <typename... Ts>
+    ECS::View<Ts...> view();
     ECS::Map map;
-    std::vector<Entity> entities;
-    int player_entity_index;
+    ECS::Storage entities;
+    ECS::RenderCache entity_render_cache;
+    ECS::SpatialHash entity_index;
+    ECS::EntityHandle player_entity;
 };
 
+template <typename... Ts>
+ECS::View<Ts...> Manager::view()
+{
+    return this->entities.view<Ts...>();
+}
+
 }; // namespace ECS
 
 #endif
\ No newline at end of file
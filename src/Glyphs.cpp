@@ -0,0 +1,186 @@
+#include "Glyphs.h"
+#include "SDLWrapper.h"
+#include <stdio.h>
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+
+struct GlyphSet
+{
+    std::vector<Glyphs::Glyph> glyphs;
+    // ARGB8888 copies of the glyph images for bake_text, nullptr where there's
+    // nothing to draw.
+    std::vector<SDL_Surface *> images;
+    int height;
+};
+// Most recently used layouts at the front of entries.
+struct LayoutCache
+{
+    typedef std::list<std::pair<std::string, std::shared_ptr<const Glyphs::Layout>>> Entries;
+    Entries entries;
+    std::unordered_map<std::string, LayoutCache::Entries::iterator> index;
+};
+static std::vector<GlyphSet> glyph_sets;
+static std::vector<LayoutCache> layout_caches;
+
+// Each glyph is rendered as a one character string so it lines up the way
+// TTF_RenderText would place it.
+static GlyphSet *get_glyph_set(int font_index)
+{
+    Font *font = Assets::get_font(font_index);
+    if (font == nullptr)
+    {
+        return nullptr;
+    }
+    if (font_index >= static_cast<int>(glyph_sets.size()))
+    {
+        glyph_sets.resize(font_index + 1);
+        layout_caches.resize(font_index + 1);
+    }
+    GlyphSet *set = &glyph_sets[font_index];
+    if (!set->glyphs.empty())
+    {
+        return set;
+    }
+    set->height = TTF_FontHeight(font);
+    set->glyphs.resize(Glyphs::LAST_GLYPH - Glyphs::FIRST_GLYPH + 1);
+    set->images.resize(set->glyphs.size(), nullptr);
+    for (int c = Glyphs::FIRST_GLYPH; c <= Glyphs::LAST_GLYPH; ++c)
+    {
+        Glyphs::Glyph *glyph = &set->glyphs[c - Glyphs::FIRST_GLYPH];
+        int min_x, max_x, min_y, max_y;
+        if (TTF_GlyphMetrics(font, c, &min_x, &max_x, &min_y, &max_y, &glyph->advance) != 0)
+        {
+            glyph->advance = 0;
+            min_x = 0;
+        }
+        // TTF_RenderText shifts a string right when its first glyph starts
+        // left of the pen, so a one character render starts at the pen or
+        // at min_x, whichever is further left.
+        glyph->bearing = std::min(0, min_x);
+        glyph->texture_index = -1;
+        if (c == ' ')
+        {
+            continue;
+        }
+        char text[2] = {static_cast<char>(c), '\0'};
+        SDL_Surface *rendered = TTF_RenderText_Solid(font, text, {0xFF, 0xFF, 0xFF, 0xFF});
+        if (rendered == nullptr)
+        {
+            printf("Unable to render glyph %d! SDL_ttf Error: %s\n", c, TTF_GetError());
+            continue;
+        }
+        SDL_Surface *image = SDL_ConvertSurfaceFormat(rendered, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(rendered);
+        if (image == nullptr)
+        {
+            continue;
+        }
+        SDL_SetSurfaceBlendMode(image, SDL_BLENDMODE_BLEND);
+        char key[32];
+        snprintf(key, sizeof(key), "glyph_%d_%d", font_index, c);
+        glyph->texture_index = Assets::create_texture_from_surface(SDL::get_renderer(), key, image).texture_index;
+        set->images[c - Glyphs::FIRST_GLYPH] = image;
+    }
+    return set;
+}
+
+std::shared_ptr<const Glyphs::Layout> Glyphs::layout_text(int font_index, const std::string &text)
+{
+    GlyphSet *set = get_glyph_set(font_index);
+    if (set == nullptr)
+    {
+        printf("Error: layout_text received a bad font_index %d\n", font_index);
+        return nullptr;
+    }
+    LayoutCache *cache = &layout_caches[font_index];
+    auto it = cache->index.find(text);
+    if (it != cache->index.end())
+    {
+        cache->entries.splice(cache->entries.begin(), cache->entries, it->second);
+        return it->second->second;
+    }
+    if (static_cast<int>(cache->entries.size()) >= Glyphs::LAYOUT_CACHE_SIZE)
+    {
+        cache->index.erase(cache->entries.back().first);
+        cache->entries.pop_back();
+    }
+    std::shared_ptr<Glyphs::Layout> layout(new Glyphs::Layout());
+    auto texture_table = Assets::get_texture_table();
+    Font *font = Assets::get_font(font_index);
+    bool kerning = TTF_GetFontKerning(font) != 0;
+    int pen_x = 0;
+    int left = 0;
+    int right = 0;
+    char previous = 0;
+    for (char c : text)
+    {
+        if (c < Glyphs::FIRST_GLYPH || c > Glyphs::LAST_GLYPH)
+        {
+            c = '?';
+        }
+        if (kerning && previous != 0)
+        {
+            pen_x += TTF_GetFontKerningSizeGlyphs(font, previous, c);
+        }
+        previous = c;
+        const Glyphs::Glyph &glyph = set->glyphs[c - Glyphs::FIRST_GLYPH];
+        if (glyph.texture_index != -1)
+        {
+            int x = pen_x + glyph.bearing;
+            layout->quads.push_back({glyph.texture_index, {x, 0}, c});
+            left = std::min(left, x);
+            right = std::max(right, x + texture_table->at(glyph.texture_index)->dimensions.x);
+        }
+        pen_x += glyph.advance;
+    }
+    // Like TTF_RenderText, a string that reaches left of its first pen
+    // position is shifted so it starts at 0.
+    for (Glyphs::Layout::Quad &quad : layout->quads)
+    {
+        quad.offset.x -= left;
+    }
+    layout->dimensions = {std::max(right, pen_x) - left, text.empty() ? 0 : set->height};
+    cache->entries.emplace_front(text, layout);
+    cache->index[text] = cache->entries.begin();
+    return layout;
+}
+
+void Glyphs::render_text(Render::Layer layer, const Glyphs::Layout &layout, V2 position, Rect *overflow_clip, int z_index)
+{
+    for (const Glyphs::Layout::Quad &quad : layout.quads)
+    {
+        V2 glyph_position = {position.x + quad.offset.x, position.y + quad.offset.y};
+        Render::render_texture(layer, quad.texture_index, glyph_position, overflow_clip, 1, z_index);
+    }
+}
+
+TextTextureInfo Glyphs::bake_text(int font_index, const std::string &texture_key, const Glyphs::Layout &layout)
+{
+    GlyphSet *set = get_glyph_set(font_index);
+    if (set == nullptr || layout.dimensions.x <= 0 || layout.dimensions.y <= 0)
+    {
+        return {-1};
+    }
+    SDL_Surface *text_surface = SDL_CreateRGBSurfaceWithFormat(0, layout.dimensions.x, layout.dimensions.y, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (text_surface == nullptr)
+    {
+        printf("Unable to create text surface! SDL Error: %s\n", SDL_GetError());
+        return {-1};
+    }
+    // Glyph pixels are either clear or opaque, so blending them onto the
+    // cleared surface gives the same image TTF_RenderText would.
+    for (const Glyphs::Layout::Quad &quad : layout.quads)
+    {
+        SDL_Surface *image = set->images[quad.glyph - Glyphs::FIRST_GLYPH];
+        if (image == nullptr)
+        {
+            continue;
+        }
+        SDL_Rect destination = {quad.offset.x, quad.offset.y, image->w, image->h};
+        SDL_BlitSurface(image, nullptr, text_surface, &destination);
+    }
+    TextTextureInfo info = Assets::create_texture_from_surface(SDL::get_renderer(), texture_key, text_surface);
+    SDL_FreeSurface(text_surface);
+    return info;
+}
@@ -0,0 +1,59 @@
+#ifndef GLYPHS_h_
+#define GLYPHS_h_
+
+#include "GameTypes.h"
+#include "Render.h"
+#include "Assets.h"
+#include <string>
+#include <vector>
+#include <memory>
+
+// Text drawn from pre-rasterized glyphs. The first time a font is used its
+// printable ASCII glyphs are rendered once into the text atlas; after that a
+// string is just a list of glyph quads, so changing text never creates
+// textures. Quads are placed with the font's kerning the way TTF_RenderText
+// would place them.
+namespace Glyphs
+{
+const static int FIRST_GLYPH = 32;
+const static int LAST_GLYPH = 126;
+// Laid out strings kept per font; the least recently used go first.
+const static int LAYOUT_CACHE_SIZE = 512;
+
+struct Glyph
+{
+    // -1 for glyphs with nothing to draw, like space.
+    int texture_index;
+    int advance;
+    // Where the glyph's image starts relative to the pen, negative for glyphs
+    // that reach back over the previous one.
+    int bearing;
+};
+
+struct Layout
+{
+    struct Quad
+    {
+        int texture_index;
+        V2 offset;
+        char glyph;
+    };
+    std::vector<Glyphs::Layout::Quad> quads;
+    V2 dimensions;
+};
+
+// Shared so a cached layout stays valid for whoever holds it after it's
+// evicted. Returns nullptr for a bad font index.
+std::shared_ptr<const Glyphs::Layout> layout_text(int font_index, const std::string &text);
+void render_text(
+    Render::Layer layer,
+    const Glyphs::Layout &layout,
+    V2 position,
+    Rect *overflow_clip = nullptr,
+    int z_index = 1);
+// Draws the layout's glyphs into the texture under texture_key, so the string
+// can go out as a single copy when the renderer can't batch glyph quads.
+TextTextureInfo bake_text(int font_index, const std::string &texture_key, const Glyphs::Layout &layout);
+}; // namespace Glyphs
+
+#endif
@@ -0,0 +1,245 @@
+#include "Jobs.h"
+#include <thread>
+#include <deque>
+#include <memory>
+#include <condition_variable>
+#include <chrono>
+#include <stdio.h>
+
+struct WorkQueue
+{
+    std::mutex mutex;
+    std::deque<Jobs::Job> jobs;
+};
+
+// queues[0] belongs to the main thread, queues[n] to workers[n - 1].
+static std::vector<std::unique_ptr<WorkQueue>> queues;
+static std::vector<std::thread> workers;
+static WorkQueue main_thread_queue;
+static std::atomic<bool> running(false);
+static std::atomic<int> queued_jobs(0);
+static std::mutex sleep_mutex;
+static std::condition_variable sleep_condition;
+static thread_local int queue_index = 0;
+
+static bool pop_job(WorkQueue *queue, Jobs::Job *job, bool from_back)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (queue->jobs.empty())
+    {
+        return false;
+    }
+    if (from_back)
+    {
+        *job = queue->jobs.back();
+        queue->jobs.pop_back();
+    }
+    else
+    {
+        *job = queue->jobs.front();
+        queue->jobs.pop_front();
+    }
+    return true;
+}
+
+static bool try_get_job(Jobs::Job *job)
+{
+    if (queues.empty())
+    {
+        return false;
+    }
+    int count = queues.size();
+    if (pop_job(queues[queue_index].get(), job, true))
+    {
+        --queued_jobs;
+        return true;
+    }
+    for (int i = 1; i < count; ++i)
+    {
+        if (pop_job(queues[(queue_index + i) % count].get(), job, false))
+        {
+            --queued_jobs;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void finish(Jobs::Counter *counter)
+{
+    if (counter == nullptr)
+    {
+        return;
+    }
+    std::vector<Jobs::Job> ready;
+    {
+        // Decrement under the lock so a waiter can't see zero and destroy the
+        // counter while we're still draining its continuations.
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (--counter->value > 0)
+        {
+            return;
+        }
+        ready.swap(counter->continuations);
+    }
+    for (Jobs::Job &job : ready)
+    {
+        // The job's own counter was already bumped in run_after.
+        Jobs::run(job, nullptr);
+    }
+}
+
+static void execute(Jobs::Job *job)
+{
+    job->function(job->data, job->begin, job->end);
+    finish(job->counter);
+}
+
+static void worker_loop(int index)
+{
+    queue_index = index;
+    while (running)
+    {
+        Jobs::Job job;
+        if (try_get_job(&job))
+        {
+            execute(&job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleep_condition.wait_for(lock, std::chrono::milliseconds(1), [] { return queued_jobs > 0 || !running; });
+    }
+}
+
+Jobs::Counter::Counter() : value(0){};
+
+void Jobs::init(int worker_count)
+{
+    if (running)
+    {
+        return;
+    }
+    if (worker_count < 0)
+    {
+        worker_count = std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0);
+    }
+    running = true;
+    queue_index = 0;
+    for (int i = 0; i <= worker_count; ++i)
+    {
+        queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+    for (int i = 1; i <= worker_count; ++i)
+    {
+        workers.push_back(std::thread(worker_loop, i));
+    }
+    printf("Job system started with %d workers\n", worker_count);
+}
+
+void Jobs::shutdown()
+{
+    if (!running)
+    {
+        return;
+    }
+    running = false;
+    sleep_condition.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+    queues.clear();
+}
+
+int Jobs::worker_count()
+{
+    return workers.size();
+}
+
+bool Jobs::is_main_thread()
+{
+    return queue_index == 0;
+}
+
+void Jobs::run(Jobs::Job job, Jobs::Counter *counter)
+{
+    if (counter != nullptr)
+    {
+        ++counter->value;
+        job.counter = counter;
+    }
+    if (queues.empty())
+    {
+        // Not initialized, just do it now.
+        execute(&job);
+        return;
+    }
+    {
+        WorkQueue *queue = queues[queue_index].get();
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->jobs.push_back(job);
+    }
+    ++queued_jobs;
+    sleep_condition.notify_one();
+}
+
+void Jobs::run_after(Jobs::Counter *dependency, Jobs::Job job, Jobs::Counter *counter)
+{
+    job.counter = counter;
+    if (counter != nullptr)
+    {
+        ++counter->value;
+    }
+    {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (dependency->value > 0)
+        {
+            dependency->continuations.push_back(job);
+            return;
+        }
+    }
+    Jobs::run(job, nullptr);
+}
+
+void Jobs::run_on_main_thread(Jobs::Job job, Jobs::Counter *counter)
+{
+    job.counter = counter;
+    if (counter != nullptr)
+    {
+        ++counter->value;
+    }
+    std::lock_guard<std::mutex> lock(main_thread_queue.mutex);
+    main_thread_queue.jobs.push_back(job);
+}
+
+void Jobs::pump_main_thread()
+{
+    Jobs::Job job;
+    while (pop_job(&main_thread_queue, &job, false))
+    {
+        execute(&job);
+    }
+}
+
+void Jobs::wait(Jobs::Counter *counter)
+{
+    while (counter->value > 0)
+    {
+        Jobs::Job job;
+        if (Jobs::is_main_thread() && pop_job(&main_thread_queue, &job, false))
+        {
+            execute(&job);
+        }
+        else if (try_get_job(&job))
+        {
+            execute(&job);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    // Whoever took the counter to zero may still be holding its lock.
+    std::lock_guard<std::mutex> lock(counter->mutex);
+}
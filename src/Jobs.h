@@ -0,0 +1,66 @@
+#ifndef JOBS_h_
+#define JOBS_h_
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+// Work-stealing job system. Every worker owns a deque: it pushes and pops its
+// own jobs at the back and steals from the front of everybody else's. The main
+// thread owns queue 0 and helps out whenever it waits on a Counter.
+namespace Jobs
+{
+struct Counter;
+typedef void (*JobFunction)(void *data, int begin, int end);
+struct Job
+{
+    JobFunction function = nullptr;
+    void *data = nullptr;
+    int begin = 0;
+    int end = 0;
+    Counter *counter = nullptr;
+};
+// Counts jobs that haven't finished yet. Jobs scheduled with run_after wait
+// until their dependency's counter reaches zero.
+struct Counter
+{
+    Counter();
+    std::atomic<int> value;
+    std::mutex mutex;
+    std::vector<Job> continuations;
+};
+void init(int worker_count = -1);
+void shutdown();
+int worker_count();
+bool is_main_thread();
+void run(Job, Counter * = nullptr);
+void run_after(Counter *dependency, Job, Counter * = nullptr);
+// For work that has to happen on the main thread (anything touching SDL).
+void run_on_main_thread(Job, Counter * = nullptr);
+void pump_main_thread();
+void wait(Counter *);
+
+template <typename F>
+void parallel_for(int begin, int end, int grain, const F &f)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+    grain = std::max(grain, 1);
+    Counter counter;
+    Job job;
+    job.function = [](void *data, int b, int e) { (*static_cast<const F *>(data))(b, e); };
+    job.data = const_cast<F *>(&f);
+    for (int i = begin; i < end; i += grain)
+    {
+        job.begin = i;
+        job.end = std::min(end, i + grain);
+        Jobs::run(job, &counter);
+    }
+    Jobs::wait(&counter);
+}
+}; // namespace Jobs
+
+#endif
@@ -1,14 +1,22 @@
 #include "MessageBus.h"
+#include <assert.h>
 #include <stdio.h>
+#include <vector>
 
 static MBus::Message order_message_queue[MBus::ORDER_MESSAGE_QUEUE_SIZE];
 static MBus::Message ecs_message_queue[MBus::ECS_MESSAGE_QUEUE_SIZE];
 static MBus::Message gui_message_queue[MBus::GUI_MESSAGE_QUEUE_SIZE];
 static MBus::Message debug_message_queue[MBus::DEBUG_MESSAGE_QUEUE_SIZE];
+static MBus::Message path_message_queue[MBus::PATH_MESSAGE_QUEUE_SIZE];
+static MBus::Message path_reply_queue[MBus::PATH_REPLY_QUEUE_SIZE];
 static int order_message_queue_length = 0;
 static int ecs_message_queue_length = 0;
 static int gui_message_queue_length = 0;
 static int debug_message_queue_length = 0;
+static int path_message_queue_length = 0;
+static int path_reply_queue_length = 0;
+static std::vector<unsigned char> ecs_payload;
+static std::vector<unsigned char> path_payload;
 
 void MBus::send_order_message(MBus::Message *m)
 {
@@ -30,14 +38,53 @@ void MBus::send_debug_message(MBus::Message *m)
     MBus::send_message(debug_message_queue, m, &debug_message_queue_length, MBus::DEBUG_MESSAGE_QUEUE_SIZE);
 }
 
-void MBus::send_message(MBus::Message message_queue[], MBus::Message *message, int *message_queue_length, int message_queue_size)
+bool MBus::send_path_message(MBus::Message *m)
+{
+    return MBus::send_message(path_message_queue, m, &path_message_queue_length, MBus::PATH_MESSAGE_QUEUE_SIZE);
+}
+
+bool MBus::send_path_reply(MBus::Message *m)
+{
+    return MBus::send_message(path_reply_queue, m, &path_reply_queue_length, MBus::PATH_REPLY_QUEUE_SIZE);
+}
+
+bool MBus::send_message(MBus::Message message_queue[], MBus::Message *message, int *message_queue_length, int message_queue_size)
 {
     if (*message_queue_length > message_queue_size - 1)
     {
         printf("Warning: message_queue is full, consider increasing the size from %d\n", message_queue_size);
-        return;
+        return false;
     }
     message_queue[(*message_queue_length)++] = *message;
+    return true;
+}
+
+int MBus::send_ecs_payload(const void *data, int size)
+{
+    int offset = ecs_payload.size();
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    ecs_payload.insert(ecs_payload.end(), bytes, bytes + size);
+    return offset;
+}
+
+const unsigned char *MBus::get_ecs_payload(int offset)
+{
+    assert(offset >= 0 && offset <= static_cast<int>(ecs_payload.size()));
+    return ecs_payload.data() + offset;
+}
+
+int MBus::send_path_payload(const void *data, int size)
+{
+    int offset = path_payload.size();
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    path_payload.insert(path_payload.end(), bytes, bytes + size);
+    return offset;
+}
+
+const unsigned char *MBus::get_path_payload(int offset)
+{
+    assert(offset >= 0 && offset <= static_cast<int>(path_payload.size()));
+    return path_payload.data() + offset;
 }
 
 MBus::MessageQueue MBus::get_queue(MBus::QueueType q_type)
@@ -63,6 +110,16 @@ MBus::MessageQueue MBus::get_queue(MBus::QueueType q_type)
         mq.queue = debug_message_queue;
         mq.length = debug_message_queue_length;
     }
+    else if (q_type == MBus::QueueType::PATH)
+    {
+        mq.queue = path_message_queue;
+        mq.length = path_message_queue_length;
+    }
+    else if (q_type == MBus::QueueType::PATH_REPLY)
+    {
+        mq.queue = path_reply_queue;
+        mq.length = path_reply_queue_length;
+    }
     return mq;
 }
 
@@ -73,6 +130,7 @@ void MBus::clear_order_messages()
 void MBus::clear_ecs_messages()
 {
     ecs_message_queue_length = 0;
+    ecs_payload.clear();
 }
 void MBus::clear_gui_messages()
 {
@@ -82,4 +140,15 @@ void MBus::clear_gui_messages()
 void MBus::clear_debug_messages()
 {
     debug_message_queue_length = 0;
+}
+
+void MBus::clear_path_messages()
+{
+    path_message_queue_length = 0;
+}
+
+void MBus::clear_path_replies()
+{
+    path_reply_queue_length = 0;
+    path_payload.clear();
 }
\ No newline at end of file
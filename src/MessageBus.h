@@ -11,6 +11,8 @@ const static int ORDER_MESSAGE_QUEUE_SIZE = 8192;
 const static int ECS_MESSAGE_QUEUE_SIZE = 8192;
 const static int GUI_MESSAGE_QUEUE_SIZE = 8192;
 const static int DEBUG_MESSAGE_QUEUE_SIZE = 8192;
+const static int PATH_MESSAGE_QUEUE_SIZE = 8192;
+const static int PATH_REPLY_QUEUE_SIZE = 8192;
 enum Type
 {
     // ORDER
@@ -19,8 +21,11 @@ enum Type
     BEGIN_BUILDABLE_PLACEMENT,
     // ECS
     CREATE_TILE,
+    FILL_TILE_RECT,
+    FILL_TILE_MASK,
     HANDLE_CAMERA_RESIZE_FOR_PLAYER,
     CREATE_ENTITY,
+    DESTROY_ENTITY,
     // GUI
     TOGGLE_BUILD_MENU,
     CLOSE_BUILD_MENU,
@@ -28,8 +33,14 @@ enum Type
     // DEBUG
     ENTITIES_RENDERED,
     MESSAGES_IN_RENDER_QUEUE,
+    RENDER_QUEUE_HIGH_WATER_MARK,
+    DRAW_CALLS,
+    RENDER_STATE_CHANGES,
     ENTITIES_PROCESSED,
-    TILES_RENDERED
+    TILES_RENDERED,
+    // PATH
+    FIND_PATH,
+    PATH_FOUND
 };
 struct HandleCameraResizeForPlayer
 {
@@ -44,6 +55,24 @@ struct MessagesInRenderQueue
 {
     int num;
 };
+// Most events the render queue has held in one frame.
+struct RenderQueueHighWaterMark
+{
+    int num;
+};
+// batches is how many runs of same-texture sprites were drawn together.
+struct DrawCalls
+{
+    int num;
+    int batches;
+};
+// Renderer state calls made this frame and calls skipped because they
+// wouldn't have changed anything.
+struct RenderStateChanges
+{
+    int issued;
+    int elided;
+};
 struct TilesRendered
 {
     int num;
@@ -57,11 +86,44 @@ struct CreateTile
     V2 grid_position;
     const ECS::Entity *blueprint;
 };
+// Paints every cell in a grid-space rect with one blueprint.
+struct FillTileRect
+{
+    Rect area;
+    const ECS::Entity *blueprint;
+};
+// Like FillTileRect but only for cells whose bit is set in the mask, which is
+// area.w * area.h bits, row by row, stored with send_ecs_payload.
+struct FillTileMask
+{
+    Rect area;
+    const ECS::Entity *blueprint;
+    int mask_offset;
+};
 struct CreateEntity
 {
     V2 grid_position;
     const ECS::Entity *blueprint;
 };
+struct DestroyEntity
+{
+    ECS::EntityHandle entity;
+};
+// Answered by a PathFound with the same request_id on the PATH_REPLY queue.
+struct FindPath
+{
+    int request_id;
+    V2 origin;
+    V2 goal;
+};
+// length grid cells from origin to goal, both included, stored as V2s with
+// send_path_payload. length is 0 when there is no route.
+struct PathFound
+{
+    int request_id;
+    int length;
+    int path_offset;
+};
 struct BeginBuildablePlacement
 {
     const ECS::Entity *entity;
@@ -73,12 +135,20 @@ struct Message
     union {
         EntitiesRendered er;
         MessagesInRenderQueue mirq;
+        RenderQueueHighWaterMark rqhwm;
+        DrawCalls dc;
+        RenderStateChanges rsc;
         TilesRendered tr;
         EntitiesProcessed ep;
         CreateTile ct;
+        FillTileRect ftr;
+        FillTileMask ftm;
         HandleCameraResizeForPlayer hcrfp;
         BeginBuildablePlacement bbp;
         CreateEntity ce;
+        DestroyEntity de;
+        FindPath fp;
+        PathFound pf;
     } data;
 };
 enum QueueType
@@ -86,7 +156,11 @@ enum QueueType
     ORDER,
     ECS,
     GUI,
-    DEBUG
+    DEBUG,
+    PATH,
+    // PathFound replies, kept apart from the requests so a flood of one can't
+    // crowd out the other.
+    PATH_REPLY
 };
 struct MessageQueue
 {
@@ -97,11 +171,26 @@ void send_order_message(MBus::Message *);
 void send_ecs_message(MBus::Message *);
 void send_gui_message(MBus::Message *);
 void send_debug_message(MBus::Message *);
+bool send_path_message(MBus::Message *);
+bool send_path_reply(MBus::Message *);
 void clear_order_messages();
 void clear_ecs_messages();
 void clear_gui_messages();
 void clear_debug_messages();
-void send_message(MBus::Message[], MBus::Message *, int *message_queue_length, int message_queue_size);
+void clear_path_messages();
+// Replies stay readable from the update that posts them until the next one,
+// so every reader sees each reply for one full frame wherever it runs.
+void clear_path_replies();
+// Returns false, after printing a warning, when the queue is full and the
+// message was dropped.
+bool send_message(MBus::Message[], MBus::Message *, int *message_queue_length, int message_queue_size);
+// Variable sized data that rides along with ECS messages. Returns an offset to
+// put in the message; the data lives until clear_ecs_messages.
+int send_ecs_payload(const void *data, int size);
+const unsigned char *get_ecs_payload(int offset);
+// Same as the ECS payload, for path replies; lives until clear_path_replies.
+int send_path_payload(const void *data, int size);
+const unsigned char *get_path_payload(int offset);
 MBus::MessageQueue get_queue(MBus::QueueType);
 }; // namespace MBus
 
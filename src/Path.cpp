@@ -0,0 +1,1152 @@
+#include "Path.h"
+#include "MessageBus.h"
+#include "Jobs.h"
+#include <atomic>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+static thread_local Path::Search thread_search;
+static std::atomic<int> next_request_id(1);
+
+static inline bool is_walkable(const ECS::Bitmap *walkable, int x, int y)
+{
+    return x >= 0 && y >= 0 && x < walkable->dimensions.x && y < walkable->dimensions.y && walkable->test({x, y});
+}
+
+static inline int octile_distance(int x0, int y0, int x1, int y1)
+{
+    int dx = abs(x1 - x0);
+    int dy = abs(y1 - y0);
+    return Path::STRAIGHT_COST * std::max(dx, dy) + (Path::DIAGONAL_COST - Path::STRAIGHT_COST) * std::min(dx, dy);
+}
+
+static inline int sign(int value)
+{
+    return (value > 0) - (value < 0);
+}
+
+// A functor rather than a function so the heap operations inline it.
+struct CompareNodes
+{
+    bool operator()(const Path::Search::Node &a, const Path::Search::Node &b) const
+    {
+        return a.f > b.f;
+    }
+};
+static const CompareNodes compare_nodes = {};
+
+// Walks from (x, y) in direction (dx, dy) until it reaches the goal or a cell
+// with a forced neighbour, which becomes the next jump point.
+static bool jump(const ECS::Bitmap *walkable, int x, int y, int dx, int dy, V2 goal, V2 *jump_point)
+{
+    while (true)
+    {
+        if (!is_walkable(walkable, x, y))
+        {
+            return false;
+        }
+        if (x == goal.x && y == goal.y)
+        {
+            *jump_point = {x, y};
+            return true;
+        }
+        if (dx != 0 && dy != 0)
+        {
+            V2 unused;
+            if (jump(walkable, x + dx, y, dx, 0, goal, &unused) || jump(walkable, x, y + dy, 0, dy, goal, &unused))
+            {
+                *jump_point = {x, y};
+                return true;
+            }
+        }
+        else if (dx != 0)
+        {
+            if ((is_walkable(walkable, x, y - 1) && !is_walkable(walkable, x - dx, y - 1)) ||
+                (is_walkable(walkable, x, y + 1) && !is_walkable(walkable, x - dx, y + 1)))
+            {
+                *jump_point = {x, y};
+                return true;
+            }
+        }
+        else
+        {
+            if ((is_walkable(walkable, x - 1, y) && !is_walkable(walkable, x - 1, y - dy)) ||
+                (is_walkable(walkable, x + 1, y) && !is_walkable(walkable, x + 1, y - dy)))
+            {
+                *jump_point = {x, y};
+                return true;
+            }
+        }
+        // No corner cutting: a diagonal step needs both sides open.
+        if (!is_walkable(walkable, x + dx, y) || !is_walkable(walkable, x, y + dy))
+        {
+            return false;
+        }
+        x += dx;
+        y += dy;
+    }
+}
+
+// Directions worth jumping in from a node, given the direction it was reached
+// from. Returns the number written to directions.
+static int prune_directions(const ECS::Bitmap *walkable, int x, int y, int dx, int dy, V2 directions[8])
+{
+    int count = 0;
+    if (dx == 0 && dy == 0)
+    {
+        for (int ny = -1; ny <= 1; ++ny)
+        {
+            for (int nx = -1; nx <= 1; ++nx)
+            {
+                if ((nx != 0 || ny != 0) && is_walkable(walkable, x + nx, y + ny) &&
+                    is_walkable(walkable, x + nx, y) && is_walkable(walkable, x, y + ny))
+                {
+                    directions[count++] = {nx, ny};
+                }
+            }
+        }
+        return count;
+    }
+    if (dx != 0 && dy != 0)
+    {
+        bool vertical = is_walkable(walkable, x, y + dy);
+        bool horizontal = is_walkable(walkable, x + dx, y);
+        if (vertical)
+        {
+            directions[count++] = {0, dy};
+        }
+        if (horizontal)
+        {
+            directions[count++] = {dx, 0};
+        }
+        if (vertical && horizontal)
+        {
+            directions[count++] = {dx, dy};
+        }
+        return count;
+    }
+    if (dx != 0)
+    {
+        bool next = is_walkable(walkable, x + dx, y);
+        bool below = is_walkable(walkable, x, y + 1);
+        bool above = is_walkable(walkable, x, y - 1);
+        if (next)
+        {
+            directions[count++] = {dx, 0};
+            if (below)
+            {
+                directions[count++] = {dx, 1};
+            }
+            if (above)
+            {
+                directions[count++] = {dx, -1};
+            }
+        }
+        if (below)
+        {
+            directions[count++] = {0, 1};
+        }
+        if (above)
+        {
+            directions[count++] = {0, -1};
+        }
+        return count;
+    }
+    bool next = is_walkable(walkable, x, y + dy);
+    bool right = is_walkable(walkable, x + 1, y);
+    bool left = is_walkable(walkable, x - 1, y);
+    if (next)
+    {
+        directions[count++] = {0, dy};
+        if (right)
+        {
+            directions[count++] = {1, dy};
+        }
+        if (left)
+        {
+            directions[count++] = {-1, dy};
+        }
+    }
+    if (right)
+    {
+        directions[count++] = {1, 0};
+    }
+    if (left)
+    {
+        directions[count++] = {-1, 0};
+    }
+    return count;
+}
+
+Path::Search::Search() : generation(0){};
+
+bool Path::find_path(const ECS::Bitmap *walkable, V2 origin, V2 goal, std::vector<V2> *path, Path::Search *search)
+{
+    path->clear();
+    if (!is_walkable(walkable, origin.x, origin.y) || !is_walkable(walkable, goal.x, goal.y))
+    {
+        return false;
+    }
+    if (origin.x == goal.x && origin.y == goal.y)
+    {
+        path->push_back(origin);
+        return true;
+    }
+    int width = walkable->dimensions.x;
+    int cell_count = width * walkable->dimensions.y;
+    if (static_cast<int>(search->g.size()) != cell_count)
+    {
+        search->g.assign(cell_count, 0);
+        search->parent.assign(cell_count, -1);
+        search->opened.assign(cell_count, 0);
+        search->closed.assign(cell_count, 0);
+        search->generation = 0;
+    }
+    uint32_t generation = ++search->generation;
+    search->open.clear();
+
+    int start = origin.y * width + origin.x;
+    int end = goal.y * width + goal.x;
+    search->g[start] = 0;
+    search->parent[start] = -1;
+    search->opened[start] = generation;
+    search->open.push_back({octile_distance(origin.x, origin.y, goal.x, goal.y), start});
+    bool found = false;
+    while (!search->open.empty())
+    {
+        std::pop_heap(search->open.begin(), search->open.end(), compare_nodes);
+        int index = search->open.back().index;
+        search->open.pop_back();
+        if (search->closed[index] == generation)
+        {
+            continue;
+        }
+        search->closed[index] = generation;
+        if (index == end)
+        {
+            found = true;
+            break;
+        }
+        int x = index % width;
+        int y = index / width;
+        int dx = 0;
+        int dy = 0;
+        if (search->parent[index] != -1)
+        {
+            dx = sign(x - search->parent[index] % width);
+            dy = sign(y - search->parent[index] / width);
+        }
+        V2 directions[8];
+        int direction_count = prune_directions(walkable, x, y, dx, dy, directions);
+        for (int i = 0; i < direction_count; ++i)
+        {
+            V2 jump_point;
+            if (!jump(walkable, x + directions[i].x, y + directions[i].y, directions[i].x, directions[i].y, goal, &jump_point))
+            {
+                continue;
+            }
+            int next = jump_point.y * width + jump_point.x;
+            if (search->closed[next] == generation)
+            {
+                continue;
+            }
+            int g = search->g[index] + octile_distance(x, y, jump_point.x, jump_point.y);
+            if (search->opened[next] != generation || g < search->g[next])
+            {
+                search->opened[next] = generation;
+                search->g[next] = g;
+                search->parent[next] = index;
+                search->open.push_back({g + octile_distance(jump_point.x, jump_point.y, goal.x, goal.y), next});
+                std::push_heap(search->open.begin(), search->open.end(), compare_nodes);
+            }
+        }
+    }
+    if (!found)
+    {
+        return false;
+    }
+    // Jump points are joined by straight or diagonal runs, so fill those in
+    // to give agents every cell.
+    for (int index = end; search->parent[index] != -1; index = search->parent[index])
+    {
+        int from = search->parent[index];
+        V2 cell = {index % width, index / width};
+        V2 step = {sign(from % width - cell.x), sign(from / width - cell.y)};
+        while (cell.x != from % width || cell.y != from / width)
+        {
+            path->push_back(cell);
+            cell.x += step.x;
+            cell.y += step.y;
+        }
+    }
+    path->push_back(origin);
+    std::reverse(path->begin(), path->end());
+    return true;
+}
+
+static const V2 flow_directions[8] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+
+static inline int step_cost(int d)
+{
+    return d < 4 ? Path::STRAIGHT_COST : Path::DIAGONAL_COST;
+}
+
+// A chunk plus a one cell border, copied out of the field so solving a chunk
+// doesn't need bounds checks.
+const static int PADDED_SIZE = ECS::CHUNK_SIZE + 2;
+const static uint8_t PADDED_OPEN = 1 << 0;
+const static uint8_t PADDED_INTERIOR = 1 << 1;
+static const int padded_offsets[8] = {1, -1, PADDED_SIZE, -PADDED_SIZE, PADDED_SIZE + 1, 1 - PADDED_SIZE, PADDED_SIZE - 1, -PADDED_SIZE - 1};
+// Steps cost at most DIAGONAL_COST, so a ring of buckets one bigger than that
+// is enough for a Dial-style queue.
+const static int BUCKET_COUNT = 16;
+static_assert(Path::DIAGONAL_COST < BUCKET_COUNT, "bucket ring must be wider than a step");
+struct PaddedChunk
+{
+    uint8_t cells[PADDED_SIZE * PADDED_SIZE];
+    int costs[PADDED_SIZE * PADDED_SIZE];
+    std::vector<Path::Search::Node> seeds;
+    std::vector<int> buckets[BUCKET_COUNT];
+};
+struct CompareSeeds
+{
+    bool operator()(const Path::Search::Node &a, const Path::Search::Node &b) const
+    {
+        return a.f < b.f;
+    }
+};
+static thread_local PaddedChunk padded_chunk;
+
+Path::FlowField::FlowField() : goal({0, 0, 0, 0}), dimensions({0, 0}), chunk_dimensions({0, 0}), last_used(0){};
+
+V2 Path::FlowField::get_direction(V2 cell) const
+{
+    int d = this->directions[cell.y * this->dimensions.x + cell.x];
+    return d < 0 ? V2{0, 0} : flow_directions[d];
+}
+
+int Path::FlowField::get_cost(V2 cell) const
+{
+    return this->costs[cell.y * this->dimensions.x + cell.x];
+}
+
+// pending holds, per chunk, the lowest cost that asked for it to be solved
+// again, or UNREACHABLE when nothing did.
+void Path::FlowField::activate_around(int chunk_x, int chunk_y, int cost, std::vector<int> *pending)
+{
+    for (int y = std::max(chunk_y - 1, 0); y <= std::min(chunk_y + 1, this->chunk_dimensions.y - 1); ++y)
+    {
+        for (int x = std::max(chunk_x - 1, 0); x <= std::min(chunk_x + 1, this->chunk_dimensions.x - 1); ++x)
+        {
+            int *chunk_pending = &(*pending)[y * this->chunk_dimensions.x + x];
+            *chunk_pending = std::min(*chunk_pending, cost);
+        }
+    }
+}
+
+void Path::FlowField::seed_goal(const ECS::Bitmap *walkable, int chunk_x, int chunk_y)
+{
+    this->settled[chunk_y * this->chunk_dimensions.x + chunk_x] = 0;
+    int begin_x = std::max(this->goal.x, chunk_x * ECS::CHUNK_SIZE);
+    int begin_y = std::max(this->goal.y, chunk_y * ECS::CHUNK_SIZE);
+    int end_x = std::min({this->goal.x + this->goal.w, (chunk_x + 1) * ECS::CHUNK_SIZE, this->dimensions.x});
+    int end_y = std::min({this->goal.y + this->goal.h, (chunk_y + 1) * ECS::CHUNK_SIZE, this->dimensions.y});
+    for (int y = begin_y; y < end_y; ++y)
+    {
+        for (int x = begin_x; x < end_x; ++x)
+        {
+            if (walkable->test({x, y}))
+            {
+                this->costs[y * this->dimensions.x + x] = 0;
+            }
+        }
+    }
+}
+
+static void load_padded_chunk(const ECS::Bitmap *walkable, const int *costs, int base_x, int base_y, PaddedChunk *padded)
+{
+    int width = walkable->dimensions.x;
+    for (int local_y = 0; local_y < PADDED_SIZE; ++local_y)
+    {
+        for (int local_x = 0; local_x < PADDED_SIZE; ++local_x)
+        {
+            int x = base_x + local_x - 1;
+            int y = base_y + local_y - 1;
+            int local = local_y * PADDED_SIZE + local_x;
+            padded->cells[local] = 0;
+            padded->costs[local] = Path::UNREACHABLE;
+            if (!is_walkable(walkable, x, y))
+            {
+                continue;
+            }
+            padded->cells[local] = PADDED_OPEN;
+            if (local_x > 0 && local_y > 0 && local_x <= ECS::CHUNK_SIZE && local_y <= ECS::CHUNK_SIZE)
+            {
+                padded->cells[local] |= PADDED_INTERIOR;
+            }
+            padded->costs[local] = costs[y * width + x];
+        }
+    }
+}
+
+// Dijkstra over one chunk's cells, seeded with the chunk's current costs and
+// its neighbours' border cells, which are read but never written. Costs only
+// ever go down. Returns the lowest new cost on the chunk's edge, which is what
+// the neighbouring chunks need another look for, or UNREACHABLE.
+int Path::FlowField::solve_chunk(const ECS::Bitmap *walkable, int chunk_x, int chunk_y)
+{
+    int base_x = chunk_x * ECS::CHUNK_SIZE;
+    int base_y = chunk_y * ECS::CHUNK_SIZE;
+    int width = this->dimensions.x;
+    PaddedChunk *padded = &padded_chunk;
+    load_padded_chunk(walkable, this->costs.data(), base_x, base_y, padded);
+    uint8_t *settled = &this->settled[chunk_y * this->chunk_dimensions.x + chunk_x];
+    padded->seeds.clear();
+    for (int local = 0; local < PADDED_SIZE * PADDED_SIZE; ++local)
+    {
+        if (padded->costs[local] != Path::UNREACHABLE && !(*settled && (padded->cells[local] & PADDED_INTERIOR)))
+        {
+            padded->seeds.push_back({padded->costs[local], local});
+        }
+    }
+    // Seeds come in at any cost, so they're sorted and merged in as the
+    // bucket cursor reaches them.
+    std::sort(padded->seeds.begin(), padded->seeds.end(), CompareSeeds());
+    *settled = 1;
+    int seed_count = padded->seeds.size();
+    int next_seed = 0;
+    int queued = 0;
+    int cursor = seed_count > 0 ? padded->seeds[0].f : 0;
+    while (next_seed < seed_count || queued > 0)
+    {
+        if (queued == 0)
+        {
+            cursor = std::max(cursor, padded->seeds[next_seed].f);
+        }
+        std::vector<int> *bucket = &padded->buckets[cursor % BUCKET_COUNT];
+        for (; next_seed < seed_count && padded->seeds[next_seed].f <= cursor; ++next_seed)
+        {
+            bucket->push_back(padded->seeds[next_seed].index);
+            ++queued;
+        }
+        for (int local : *bucket)
+        {
+            --queued;
+            if (padded->costs[local] != cursor)
+            {
+                continue;
+            }
+            for (int d = 0; d < 8; ++d)
+            {
+                int next = local + padded_offsets[d];
+                if (next < 0 || next >= PADDED_SIZE * PADDED_SIZE || !(padded->cells[next] & PADDED_INTERIOR))
+                {
+                    continue;
+                }
+                // No corner cutting.
+                if (d >= 4 && !((padded->cells[local + flow_directions[d].x] & PADDED_OPEN) &&
+                                (padded->cells[local + flow_directions[d].y * PADDED_SIZE] & PADDED_OPEN)))
+                {
+                    continue;
+                }
+                int cost = cursor + step_cost(d);
+                if (cost < padded->costs[next])
+                {
+                    padded->costs[next] = cost;
+                    padded->buckets[cost % BUCKET_COUNT].push_back(next);
+                    ++queued;
+                }
+            }
+        }
+        bucket->clear();
+        ++cursor;
+    }
+    int end_x = std::min(base_x + ECS::CHUNK_SIZE, this->dimensions.x);
+    int end_y = std::min(base_y + ECS::CHUNK_SIZE, this->dimensions.y);
+    int edge_changed = Path::UNREACHABLE;
+    for (int y = base_y; y < end_y; ++y)
+    {
+        for (int x = base_x; x < end_x; ++x)
+        {
+            int cost = padded->costs[(y - base_y + 1) * PADDED_SIZE + x - base_x + 1];
+            int *field_cost = &this->costs[y * width + x];
+            if (cost < *field_cost)
+            {
+                *field_cost = cost;
+                if (x == base_x || y == base_y || x == end_x - 1 || y == end_y - 1)
+                {
+                    edge_changed = std::min(edge_changed, cost);
+                }
+            }
+        }
+    }
+    return edge_changed;
+}
+
+void Path::FlowField::point_chunk(const ECS::Bitmap *walkable, int chunk_x, int chunk_y)
+{
+    int base_x = chunk_x * ECS::CHUNK_SIZE;
+    int base_y = chunk_y * ECS::CHUNK_SIZE;
+    int end_x = std::min(base_x + ECS::CHUNK_SIZE, this->dimensions.x);
+    int end_y = std::min(base_y + ECS::CHUNK_SIZE, this->dimensions.y);
+    int width = this->dimensions.x;
+    PaddedChunk *padded = &padded_chunk;
+    load_padded_chunk(walkable, this->costs.data(), base_x, base_y, padded);
+    for (int y = base_y; y < end_y; ++y)
+    {
+        for (int x = base_x; x < end_x; ++x)
+        {
+            int local = (y - base_y + 1) * PADDED_SIZE + x - base_x + 1;
+            int8_t best = -1;
+            if (padded->costs[local] != 0 && padded->costs[local] != Path::UNREACHABLE)
+            {
+                int best_cost = Path::UNREACHABLE;
+                for (int d = 0; d < 8; ++d)
+                {
+                    int neighbour = padded->costs[local + padded_offsets[d]];
+                    if (neighbour == Path::UNREACHABLE || neighbour + step_cost(d) >= best_cost)
+                    {
+                        continue;
+                    }
+                    if (d >= 4 && !((padded->cells[local + flow_directions[d].x] & PADDED_OPEN) &&
+                                    (padded->cells[local + flow_directions[d].y * PADDED_SIZE] & PADDED_OPEN)))
+                    {
+                        continue;
+                    }
+                    best_cost = neighbour + step_cost(d);
+                    best = d;
+                }
+            }
+            this->directions[y * width + x] = best;
+        }
+    }
+}
+
+// Solves pending chunks until nothing changes. Chunks are coloured by the
+// parity of their x and y so no two chunks in a batch touch, even at the
+// corners, and each batch runs in parallel. Only chunks woken by costs near
+// the lowest pending one are solved each round, so work spreads out from the
+// goal like a coarse Dijkstra instead of solving far chunks over and over.
+void Path::FlowField::integrate(const ECS::Bitmap *walkable, std::vector<int> *pending, std::vector<uint8_t> *touched)
+{
+    const int band = ECS::CHUNK_SIZE * Path::STRAIGHT_COST;
+    std::vector<int> batch;
+    std::vector<int> edge_changed(pending->size(), Path::UNREACHABLE);
+    while (true)
+    {
+        int lowest = *std::min_element(pending->begin(), pending->end());
+        if (lowest == Path::UNREACHABLE)
+        {
+            break;
+        }
+        int threshold = lowest > Path::UNREACHABLE - band ? Path::UNREACHABLE - 1 : lowest + band;
+        for (int colour = 0; colour < 4; ++colour)
+        {
+            batch.clear();
+            for (int chunk_y = colour / 2; chunk_y < this->chunk_dimensions.y; chunk_y += 2)
+            {
+                for (int chunk_x = colour % 2; chunk_x < this->chunk_dimensions.x; chunk_x += 2)
+                {
+                    int chunk = chunk_y * this->chunk_dimensions.x + chunk_x;
+                    if ((*pending)[chunk] <= threshold)
+                    {
+                        (*pending)[chunk] = Path::UNREACHABLE;
+                        (*touched)[chunk] = 1;
+                        batch.push_back(chunk);
+                    }
+                }
+            }
+            if (batch.empty())
+            {
+                continue;
+            }
+            Jobs::parallel_for(0, batch.size(), 1, [&](int begin, int end) {
+                for (int i = begin; i < end; ++i)
+                {
+                    int chunk = batch[i];
+                    edge_changed[chunk] = this->solve_chunk(walkable, chunk % this->chunk_dimensions.x, chunk / this->chunk_dimensions.x);
+                }
+            });
+            for (int chunk : batch)
+            {
+                if (edge_changed[chunk] != Path::UNREACHABLE)
+                {
+                    // A solved chunk is already settled inside; only its
+                    // neighbours need to hear about the new edge costs.
+                    this->activate_around(chunk % this->chunk_dimensions.x, chunk / this->chunk_dimensions.x, edge_changed[chunk], pending);
+                    (*pending)[chunk] = Path::UNREACHABLE;
+                }
+            }
+        }
+    }
+}
+
+void Path::FlowField::build(const ECS::Bitmap *walkable, Rect goal)
+{
+    this->goal = goal;
+    this->dimensions = walkable->dimensions;
+    this->chunk_dimensions = {
+        (this->dimensions.x + ECS::CHUNK_SIZE - 1) / ECS::CHUNK_SIZE,
+        (this->dimensions.y + ECS::CHUNK_SIZE - 1) / ECS::CHUNK_SIZE};
+    int chunk_count = this->chunk_dimensions.x * this->chunk_dimensions.y;
+    this->costs.assign(this->dimensions.x * this->dimensions.y, Path::UNREACHABLE);
+    this->directions.assign(this->dimensions.x * this->dimensions.y, -1);
+    this->settled.assign(chunk_count, 0);
+    std::vector<int> pending(chunk_count, Path::UNREACHABLE);
+    std::vector<uint8_t> touched(chunk_count, 0);
+    int begin_x = std::max(goal.x, 0) / ECS::CHUNK_SIZE;
+    int begin_y = std::max(goal.y, 0) / ECS::CHUNK_SIZE;
+    int end_x = std::min(goal.x + goal.w, this->dimensions.x) - 1;
+    int end_y = std::min(goal.y + goal.h, this->dimensions.y) - 1;
+    for (int chunk_y = begin_y; end_y >= 0 && chunk_y <= end_y / ECS::CHUNK_SIZE; ++chunk_y)
+    {
+        for (int chunk_x = begin_x; end_x >= 0 && chunk_x <= end_x / ECS::CHUNK_SIZE; ++chunk_x)
+        {
+            this->seed_goal(walkable, chunk_x, chunk_y);
+            this->activate_around(chunk_x, chunk_y, 0, &pending);
+        }
+    }
+    this->integrate(walkable, &pending, &touched);
+    Jobs::parallel_for(0, chunk_count, 4, [&](int begin, int end) {
+        for (int chunk = begin; chunk < end; ++chunk)
+        {
+            if (touched[chunk])
+            {
+                this->point_chunk(walkable, chunk % this->chunk_dimensions.x, chunk / this->chunk_dimensions.x);
+            }
+        }
+    });
+}
+
+void Path::FlowField::update(const ECS::Bitmap *walkable, const std::vector<V2> &blocked_cells, const std::vector<int> &opened_chunks)
+{
+    int width = this->dimensions.x;
+    int chunk_count = this->chunk_dimensions.x * this->chunk_dimensions.y;
+    std::vector<int> pending(chunk_count, Path::UNREACHABLE);
+    std::vector<uint8_t> touched(chunk_count, 0);
+    // Blocking only makes paths longer, so the cells to redo are the ones
+    // whose flow ran through a blocked cell, or diagonally past its corner.
+    std::vector<int> invalid;
+    for (V2 cell : blocked_cells)
+    {
+        int index = cell.y * width + cell.x;
+        if (this->costs[index] != Path::UNREACHABLE)
+        {
+            this->costs[index] = Path::UNREACHABLE;
+            invalid.push_back(index);
+        }
+        this->directions[index] = -1;
+        for (int a = 0; a < 4; ++a)
+        {
+            for (int b = 0; b < 4; ++b)
+            {
+                V2 from = {cell.x + flow_directions[a].x, cell.y + flow_directions[a].y};
+                V2 to = {cell.x + flow_directions[b].x, cell.y + flow_directions[b].y};
+                if (a / 2 == b / 2 || from.x < 0 || from.y < 0 || from.x >= width || from.y >= this->dimensions.y)
+                {
+                    continue;
+                }
+                int from_index = from.y * width + from.x;
+                int d = this->directions[from_index];
+                if (d >= 0 && flow_directions[d].x == to.x - from.x && flow_directions[d].y == to.y - from.y)
+                {
+                    this->costs[from_index] = Path::UNREACHABLE;
+                    this->directions[from_index] = -1;
+                    invalid.push_back(from_index);
+                }
+            }
+        }
+    }
+    for (int i = 0; i < static_cast<int>(invalid.size()); ++i)
+    {
+        int x = invalid[i] % width;
+        int y = invalid[i] / width;
+        this->settled[(y / ECS::CHUNK_SIZE) * this->chunk_dimensions.x + x / ECS::CHUNK_SIZE] = 0;
+        this->activate_around(x / ECS::CHUNK_SIZE, y / ECS::CHUNK_SIZE, 0, &pending);
+        for (int d = 0; d < 8; ++d)
+        {
+            int nx = x - flow_directions[d].x;
+            int ny = y - flow_directions[d].y;
+            if (nx < 0 || ny < 0 || nx >= width || ny >= this->dimensions.y)
+            {
+                continue;
+            }
+            int neighbour = ny * width + nx;
+            if (this->directions[neighbour] == d && this->costs[neighbour] != Path::UNREACHABLE)
+            {
+                this->costs[neighbour] = Path::UNREACHABLE;
+                this->directions[neighbour] = -1;
+                invalid.push_back(neighbour);
+            }
+        }
+    }
+    for (int chunk : opened_chunks)
+    {
+        int chunk_x = chunk % this->chunk_dimensions.x;
+        int chunk_y = chunk / this->chunk_dimensions.x;
+        this->seed_goal(walkable, chunk_x, chunk_y);
+        this->activate_around(chunk_x, chunk_y, 0, &pending);
+        // A newly open cell can also let diagonal steps past its corners
+        // through, and those can be inside the neighbouring chunks.
+        for (int y = std::max(chunk_y - 1, 0); y <= std::min(chunk_y + 1, this->chunk_dimensions.y - 1); ++y)
+        {
+            for (int x = std::max(chunk_x - 1, 0); x <= std::min(chunk_x + 1, this->chunk_dimensions.x - 1); ++x)
+            {
+                this->settled[y * this->chunk_dimensions.x + x] = 0;
+            }
+        }
+    }
+    // Anything marked for solving also needs its directions redone, even if
+    // solving changes nothing (e.g. a cell that became unreachable).
+    std::vector<int> repoint(pending);
+    this->integrate(walkable, &pending, &touched);
+    for (int chunk = 0; chunk < chunk_count; ++chunk)
+    {
+        if (touched[chunk])
+        {
+            this->activate_around(chunk % this->chunk_dimensions.x, chunk / this->chunk_dimensions.x, 0, &repoint);
+        }
+    }
+    Jobs::parallel_for(0, chunk_count, 4, [&](int begin, int end) {
+        for (int chunk = begin; chunk < end; ++chunk)
+        {
+            if (repoint[chunk] != Path::UNREACHABLE)
+            {
+                this->point_chunk(walkable, chunk % this->chunk_dimensions.x, chunk / this->chunk_dimensions.x);
+            }
+        }
+    });
+}
+
+static thread_local std::vector<int> fill_stack;
+
+static int find_root(std::vector<int> *parents, int node)
+{
+    while ((*parents)[node] != node)
+    {
+        (*parents)[node] = (*parents)[(*parents)[node]];
+        node = (*parents)[node];
+    }
+    return node;
+}
+
+static void join(std::vector<int> *parents, int a, int b)
+{
+    a = find_root(parents, a);
+    b = find_root(parents, b);
+    if (a != b)
+    {
+        (*parents)[std::max(a, b)] = std::min(a, b);
+    }
+}
+
+Path::Regions::Regions() : dimensions({0, 0}), chunk_dimensions({0, 0}), region_count(0){};
+
+void Path::Regions::resize(V2 dimensions)
+{
+    this->dimensions = dimensions;
+    this->chunk_dimensions = {
+        (dimensions.x + ECS::CHUNK_SIZE - 1) / ECS::CHUNK_SIZE,
+        (dimensions.y + ECS::CHUNK_SIZE - 1) / ECS::CHUNK_SIZE};
+    this->labels.assign(dimensions.x * dimensions.y, 0);
+    this->area_counts.assign(this->chunk_dimensions.x * this->chunk_dimensions.y, 0);
+    this->area_offsets.assign(this->chunk_dimensions.x * this->chunk_dimensions.y, 0);
+    this->region_ids.clear();
+    this->region_count = 0;
+}
+
+// Flood fills the chunk's walkable cells, 4-connected: with no corner
+// cutting a diagonal step needs an open side anyway.
+void Path::Regions::label_chunk(const ECS::Bitmap *walkable, int chunk_x, int chunk_y)
+{
+    int base_x = chunk_x * ECS::CHUNK_SIZE;
+    int base_y = chunk_y * ECS::CHUNK_SIZE;
+    int end_x = std::min(base_x + ECS::CHUNK_SIZE, this->dimensions.x);
+    int end_y = std::min(base_y + ECS::CHUNK_SIZE, this->dimensions.y);
+    int width = this->dimensions.x;
+    for (int y = base_y; y < end_y; ++y)
+    {
+        for (int x = base_x; x < end_x; ++x)
+        {
+            this->labels[y * width + x] = 0;
+        }
+    }
+    std::vector<int> *stack = &fill_stack;
+    uint16_t count = 0;
+    for (int y = base_y; y < end_y; ++y)
+    {
+        for (int x = base_x; x < end_x; ++x)
+        {
+            if (this->labels[y * width + x] != 0 || !walkable->test({x, y}))
+            {
+                continue;
+            }
+            ++count;
+            this->labels[y * width + x] = count;
+            stack->push_back(y * width + x);
+            while (!stack->empty())
+            {
+                int index = stack->back();
+                stack->pop_back();
+                int cx = index % width;
+                int cy = index / width;
+                for (int d = 0; d < 4; ++d)
+                {
+                    int nx = cx + flow_directions[d].x;
+                    int ny = cy + flow_directions[d].y;
+                    if (nx < base_x || nx >= end_x || ny < base_y || ny >= end_y)
+                    {
+                        continue;
+                    }
+                    int next = ny * width + nx;
+                    if (this->labels[next] == 0 && walkable->test({nx, ny}))
+                    {
+                        this->labels[next] = count;
+                        stack->push_back(next);
+                    }
+                }
+            }
+        }
+    }
+    this->area_counts[chunk_y * this->chunk_dimensions.x + chunk_x] = count;
+}
+
+void Path::Regions::update(const ECS::Bitmap *walkable, const std::vector<int> &dirty_chunks)
+{
+    Jobs::parallel_for(0, dirty_chunks.size(), 4, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+        {
+            this->label_chunk(walkable, dirty_chunks[i] % this->chunk_dimensions.x, dirty_chunks[i] / this->chunk_dimensions.x);
+        }
+    });
+    int chunk_count = this->chunk_dimensions.x * this->chunk_dimensions.y;
+    int area_total = 0;
+    for (int chunk = 0; chunk < chunk_count; ++chunk)
+    {
+        this->area_offsets[chunk] = area_total;
+        area_total += this->area_counts[chunk];
+    }
+    // Stitch neighbouring chunks together wherever walkable cells face each
+    // other across the border.
+    std::vector<int> parents(area_total);
+    for (int i = 0; i < area_total; ++i)
+    {
+        parents[i] = i;
+    }
+    int width = this->dimensions.x;
+    for (int chunk_y = 0; chunk_y < this->chunk_dimensions.y; ++chunk_y)
+    {
+        for (int chunk_x = 0; chunk_x < this->chunk_dimensions.x; ++chunk_x)
+        {
+            int chunk = chunk_y * this->chunk_dimensions.x + chunk_x;
+            int base_x = chunk_x * ECS::CHUNK_SIZE;
+            int base_y = chunk_y * ECS::CHUNK_SIZE;
+            int end_x = std::min(base_x + ECS::CHUNK_SIZE, this->dimensions.x);
+            int end_y = std::min(base_y + ECS::CHUNK_SIZE, this->dimensions.y);
+            if (chunk_x + 1 < this->chunk_dimensions.x)
+            {
+                int right = chunk + 1;
+                for (int y = base_y; y < end_y; ++y)
+                {
+                    uint16_t a = this->labels[y * width + end_x - 1];
+                    uint16_t b = this->labels[y * width + end_x];
+                    if (a != 0 && b != 0)
+                    {
+                        join(&parents, this->area_offsets[chunk] + a - 1, this->area_offsets[right] + b - 1);
+                    }
+                }
+            }
+            if (chunk_y + 1 < this->chunk_dimensions.y)
+            {
+                int below = chunk + this->chunk_dimensions.x;
+                for (int x = base_x; x < end_x; ++x)
+                {
+                    uint16_t a = this->labels[(end_y - 1) * width + x];
+                    uint16_t b = this->labels[end_y * width + x];
+                    if (a != 0 && b != 0)
+                    {
+                        join(&parents, this->area_offsets[chunk] + a - 1, this->area_offsets[below] + b - 1);
+                    }
+                }
+            }
+        }
+    }
+    // Roots always have the lowest index in their set, so numbering them in
+    // order gives compact ids.
+    this->region_ids.resize(area_total);
+    this->region_count = 0;
+    for (int i = 0; i < area_total; ++i)
+    {
+        int root = find_root(&parents, i);
+        this->region_ids[i] = root == i ? this->region_count++ : this->region_ids[root];
+    }
+}
+
+int Path::Regions::get_region(V2 cell) const
+{
+    if (cell.x < 0 || cell.y < 0 || cell.x >= this->dimensions.x || cell.y >= this->dimensions.y)
+    {
+        return -1;
+    }
+    uint16_t label = this->labels[cell.y * this->dimensions.x + cell.x];
+    if (label == 0)
+    {
+        return -1;
+    }
+    int chunk = (cell.y / ECS::CHUNK_SIZE) * this->chunk_dimensions.x + cell.x / ECS::CHUNK_SIZE;
+    return this->region_ids[this->area_offsets[chunk] + label - 1];
+}
+
+bool Path::Regions::connected(V2 a, V2 b) const
+{
+    int region = this->get_region(a);
+    return region != -1 && region == this->get_region(b);
+}
+
+int Path::request_path(V2 origin, V2 goal)
+{
+    MBus::Message m;
+    m.type = MBus::FIND_PATH;
+    m.data.fp.request_id = next_request_id++;
+    m.data.fp.origin = origin;
+    m.data.fp.goal = goal;
+    if (!MBus::send_path_message(&m))
+    {
+        return -1;
+    }
+    return m.data.fp.request_id;
+}
+
+Path::Manager::Manager() : flow_field_clock(0), cache_hits(0), cache_misses(0){};
+
+uint64_t Path::Manager::cache_key(V2 origin, V2 goal) const
+{
+    uint64_t cell_count = static_cast<uint64_t>(this->walkable.dimensions.x) * this->walkable.dimensions.y;
+    return (static_cast<uint64_t>(origin.y) * this->walkable.dimensions.x + origin.x) * cell_count +
+           static_cast<uint64_t>(goal.y) * this->walkable.dimensions.x + goal.x;
+}
+
+void Path::Manager::refresh(const ECS::Map *map)
+{
+    const ECS::Grid *grid = &map->grid;
+    bool resized = this->walkable.dimensions.x != grid->dimensions.x || this->walkable.dimensions.y != grid->dimensions.y ||
+                   this->chunk_versions.size() != grid->chunks.size();
+    if (resized)
+    {
+        this->walkable.resize(grid->dimensions);
+        this->chunk_versions.assign(grid->chunks.size(), 0);
+        this->cache.clear();
+        this->flow_fields.clear();
+        this->regions.resize(grid->dimensions);
+    }
+    bool changed = false;
+    std::vector<V2> blocked_cells;
+    std::vector<int> opened_chunks;
+    std::vector<int> dirty_chunks;
+    for (int chunk_y = 0; chunk_y < grid->chunk_dimensions.y; ++chunk_y)
+    {
+        for (int chunk_x = 0; chunk_x < grid->chunk_dimensions.x; ++chunk_x)
+        {
+            int chunk_index = chunk_y * grid->chunk_dimensions.x + chunk_x;
+            unsigned int version = grid->chunks[chunk_index].version;
+            if (this->chunk_versions[chunk_index] == version)
+            {
+                continue;
+            }
+            this->chunk_versions[chunk_index] = version;
+            // Chunks are 32 cells wide, so a chunk row is half of one word.
+            int word = chunk_x * ECS::CHUNK_SIZE / 64;
+            int end_y = std::min((chunk_y + 1) * ECS::CHUNK_SIZE, grid->dimensions.y);
+            for (int y = chunk_y * ECS::CHUNK_SIZE; y < end_y; ++y)
+            {
+                int offset = y * this->walkable.words_per_row + word;
+                uint64_t bits = (grid->layer_bits[ECS::BASE_TILE_LAYER].words[offset] |
+                                 grid->layer_bits[ECS::FLOOR_TILE_LAYER].words[offset]) &
+                                ~grid->layer_bits[ECS::OBJECT_TILE_LAYER].words[offset];
+                if (this->walkable.words[offset] == bits)
+                {
+                    continue;
+                }
+                changed = true;
+                for (uint64_t flipped = this->walkable.words[offset] ^ bits; flipped != 0; flipped &= flipped - 1)
+                {
+                    int dirty_chunk = (y / ECS::CHUNK_SIZE) * grid->chunk_dimensions.x + (word * 64 + __builtin_ctzll(flipped)) / ECS::CHUNK_SIZE;
+                    if (dirty_chunks.empty() || dirty_chunks.back() != dirty_chunk)
+                    {
+                        dirty_chunks.push_back(dirty_chunk);
+                    }
+                }
+                if (!this->flow_fields.empty())
+                {
+                    for (uint64_t blocked = this->walkable.words[offset] & ~bits; blocked != 0; blocked &= blocked - 1)
+                    {
+                        blocked_cells.push_back({word * 64 + __builtin_ctzll(blocked), y});
+                    }
+                    for (uint64_t opened = bits & ~this->walkable.words[offset]; opened != 0; opened &= opened - 1)
+                    {
+                        int opened_chunk = (y / ECS::CHUNK_SIZE) * grid->chunk_dimensions.x + (word * 64 + __builtin_ctzll(opened)) / ECS::CHUNK_SIZE;
+                        if (opened_chunks.empty() || opened_chunks.back() != opened_chunk)
+                        {
+                            opened_chunks.push_back(opened_chunk);
+                        }
+                    }
+                }
+                this->walkable.words[offset] = bits;
+            }
+        }
+    }
+    // Walkability changes anywhere can open a shorter route, so any change
+    // drops every cached path. Retiling a floor doesn't count.
+    if (changed)
+    {
+        this->cache.clear();
+        std::sort(opened_chunks.begin(), opened_chunks.end());
+        opened_chunks.erase(std::unique(opened_chunks.begin(), opened_chunks.end()), opened_chunks.end());
+        for (auto &field : this->flow_fields)
+        {
+            field->update(&this->walkable, blocked_cells, opened_chunks);
+        }
+        std::sort(dirty_chunks.begin(), dirty_chunks.end());
+        dirty_chunks.erase(std::unique(dirty_chunks.begin(), dirty_chunks.end()), dirty_chunks.end());
+        this->regions.update(&this->walkable, dirty_chunks);
+    }
+}
+
+const Path::FlowField *Path::Manager::get_flow_field(Rect goal)
+{
+    ++this->flow_field_clock;
+    Path::FlowField *oldest = nullptr;
+    for (auto &field : this->flow_fields)
+    {
+        if (field->goal.x == goal.x && field->goal.y == goal.y && field->goal.w == goal.w && field->goal.h == goal.h)
+        {
+            field->last_used = this->flow_field_clock;
+            return field.get();
+        }
+        if (oldest == nullptr || field->last_used < oldest->last_used)
+        {
+            oldest = field.get();
+        }
+    }
+    Path::FlowField *field = oldest;
+    if (static_cast<int>(this->flow_fields.size()) < Path::FLOW_FIELD_CACHE_SIZE)
+    {
+        this->flow_fields.emplace_back(new Path::FlowField());
+        field = this->flow_fields.back().get();
+    }
+    field->build(&this->walkable, goal);
+    field->last_used = this->flow_field_clock;
+    return field;
+}
+
+bool Path::Manager::find_path(V2 origin, V2 goal, std::vector<V2> *path)
+{
+    uint64_t key = this->cache_key(origin, goal);
+    auto it = this->cache.find(key);
+    if (it != this->cache.end())
+    {
+        ++this->cache_hits;
+        *path = it->second.path;
+        return it->second.found;
+    }
+    ++this->cache_misses;
+    // A search between two rooms that don't connect would visit everything
+    // reachable before giving up.
+    bool found = false;
+    path->clear();
+    if (this->regions.connected(origin, goal))
+    {
+        found = Path::find_path(&this->walkable, origin, goal, path, &thread_search);
+    }
+    if (static_cast<int>(this->cache.size()) >= Path::PATH_CACHE_SIZE)
+    {
+        this->cache.clear();
+    }
+    this->cache[key] = {*path, found};
+    return found;
+}
+
+void Path::Manager::process_messages(ECS::Map *map)
+{
+    MBus::MessageQueue mq = MBus::get_queue(MBus::QueueType::PATH);
+    for (int i = 0; i < mq.length; ++i)
+    {
+        MBus::Message m = mq.queue[i];
+        switch (m.type)
+        {
+        case MBus::Type::FIND_PATH:
+        {
+            this->requests.push_back({m.data.fp.request_id, m.data.fp.origin, m.data.fp.goal});
+            break;
+        }
+        default:
+        {
+            // NOOP
+            break;
+        }
+        }
+    }
+}
+
+void Path::Manager::update(ECS::Map *map, double ts)
+{
+    this->refresh(map);
+    if (this->requests.empty())
+    {
+        return;
+    }
+    int count = this->requests.size();
+    std::vector<Path::Manager::CachedPath> results(count);
+    std::vector<int> misses;
+    for (int i = 0; i < count; ++i)
+    {
+        auto it = this->cache.find(this->cache_key(this->requests[i].origin, this->requests[i].goal));
+        if (it != this->cache.end())
+        {
+            ++this->cache_hits;
+            results[i] = it->second;
+        }
+        else if (!this->regions.connected(this->requests[i].origin, this->requests[i].goal))
+        {
+            ++this->cache_misses;
+            results[i].found = false;
+        }
+        else
+        {
+            ++this->cache_misses;
+            misses.push_back(i);
+        }
+    }
+    // Searches only read the walkable bits, so misses run in parallel, each
+    // worker with its own scratch space.
+    Jobs::parallel_for(0, misses.size(), 4, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+        {
+            Path::Manager::Request *request = &this->requests[misses[i]];
+            Path::Manager::CachedPath *result = &results[misses[i]];
+            result->found = Path::find_path(&this->walkable, request->origin, request->goal, &result->path, &thread_search);
+        }
+    });
+    for (int i : misses)
+    {
+        if (static_cast<int>(this->cache.size()) >= Path::PATH_CACHE_SIZE)
+        {
+            this->cache.clear();
+        }
+        this->cache[this->cache_key(this->requests[i].origin, this->requests[i].goal)] = results[i];
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        MBus::Message m;
+        m.type = MBus::PATH_FOUND;
+        m.data.pf.request_id = this->requests[i].request_id;
+        m.data.pf.length = results[i].found ? results[i].path.size() : 0;
+        m.data.pf.path_offset = MBus::send_path_payload(results[i].path.data(), m.data.pf.length * sizeof(V2));
+        if (!MBus::send_path_reply(&m))
+        {
+            printf("Warning: dropped PATH_FOUND for request %d\n", m.data.pf.request_id);
+        }
+    }
+    this->requests.clear();
+}
@@ -0,0 +1,157 @@
+#ifndef PATH_h_
+#define PATH_h_
+
+#include "GameTypes.h"
+#include "Entity.h"
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <stdint.h>
+
+// Grid pathfinding. Agents walk on any cell with a base or floor tile and
+// nothing on the object layer, moving in 8 directions without cutting
+// corners. Every step costs the same, so searches use jump point search.
+namespace Path
+{
+const static int STRAIGHT_COST = 10;
+const static int DIAGONAL_COST = 14;
+const static int PATH_CACHE_SIZE = 4096;
+const static int FLOW_FIELD_CACHE_SIZE = 8;
+const static int UNREACHABLE = INT32_MAX;
+
+// Scratch space for one search, sized to the map and reused between searches
+// by bumping the generation instead of clearing.
+struct Search
+{
+    Search();
+    struct Node
+    {
+        int f;
+        int index;
+    };
+    std::vector<int> g;
+    std::vector<int> parent;
+    std::vector<uint32_t> opened;
+    std::vector<uint32_t> closed;
+    std::vector<Node> open;
+    uint32_t generation;
+};
+
+// Fills path with every cell from origin to goal, both included. Returns false
+// when there is no route.
+bool find_path(const ECS::Bitmap *walkable, V2 origin, V2 goal, std::vector<V2> *path, Path::Search *search);
+
+// Cost to reach a goal area from every cell plus the step to take from each,
+// so any number of agents heading for the same goal just look up their cell.
+// Fields are built and repaired chunk by chunk on the job system.
+struct FlowField
+{
+    FlowField();
+    void build(const ECS::Bitmap *walkable, Rect goal);
+    // Repairs the field after walkability changed. blocked_cells were walkable
+    // before and aren't now; opened_chunks gained walkable cells.
+    void update(const ECS::Bitmap *walkable, const std::vector<V2> &blocked_cells, const std::vector<int> &opened_chunks);
+    // Step {dx, dy} towards the goal, {0, 0} on the goal or when it can't be
+    // reached.
+    V2 get_direction(V2 cell) const;
+    // Path cost to the goal or UNREACHABLE.
+    int get_cost(V2 cell) const;
+    Rect goal;
+    V2 dimensions;
+    V2 chunk_dimensions;
+    std::vector<int> costs;
+    // Index into the flow directions, -1 for none.
+    std::vector<int8_t> directions;
+    // Per chunk: whether its cells are consistent with each other since its
+    // last solve, so only costs coming in over its border need spreading.
+    std::vector<uint8_t> settled;
+    unsigned int last_used;
+
+private:
+    void activate_around(int chunk_x, int chunk_y, int cost, std::vector<int> *pending);
+    void seed_goal(const ECS::Bitmap *walkable, int chunk_x, int chunk_y);
+    void integrate(const ECS::Bitmap *walkable, std::vector<int> *pending, std::vector<uint8_t> *touched);
+    int solve_chunk(const ECS::Bitmap *walkable, int chunk_x, int chunk_y);
+    void point_chunk(const ECS::Bitmap *walkable, int chunk_x, int chunk_y);
+};
+
+// Connected areas of walkable cells, i.e. the rooms agents can move around
+// in. Each chunk labels its own cells and chunks are stitched together along
+// their borders, so a tile edit only relabels the chunks it touched plus a
+// pass over the much smaller graph of chunk-local areas.
+struct Regions
+{
+    Regions();
+    void resize(V2 dimensions);
+    // Relabels dirty_chunks and re-stitches the chunks together.
+    void update(const ECS::Bitmap *walkable, const std::vector<int> &dirty_chunks);
+    // Region of the cell, from 0 to region_count - 1, or -1 if it isn't
+    // walkable. Ids are only stable until the next update.
+    int get_region(V2 cell) const;
+    bool connected(V2 a, V2 b) const;
+    V2 dimensions;
+    V2 chunk_dimensions;
+    // Per cell, row-major: the chunk-local area + 1, or 0 if not walkable.
+    std::vector<uint16_t> labels;
+    // Per chunk: how many local areas it has and where they start in
+    // region_ids.
+    std::vector<int> area_counts;
+    std::vector<int> area_offsets;
+    std::vector<int> region_ids;
+    int region_count;
+
+private:
+    void label_chunk(const ECS::Bitmap *walkable, int chunk_x, int chunk_y);
+};
+
+// Sends a FIND_PATH message and returns its request id, or -1 if the PATH
+// queue is full and the request was dropped. The PATH_FOUND reply with the
+// same id shows up on the PATH_REPLY queue once the manager's next update has
+// run and stays there for one frame.
+int request_path(V2 origin, V2 goal);
+
+struct Manager
+{
+    Manager();
+    // Collects FIND_PATH requests sent since the last frame.
+    void process_messages(ECS::Map *);
+    // Picks up tile edits, answers the collected requests in parallel and
+    // posts a PATH_FOUND reply for each.
+    void update(ECS::Map *, double);
+    // Synchronous, cached lookup. Must be called after update has seen the
+    // map's latest tiles.
+    bool find_path(V2 origin, V2 goal, std::vector<V2> *path);
+    // Cached flow field towards every walkable cell in goal, built on first
+    // use and repaired by refresh after tile edits.
+    const Path::FlowField *get_flow_field(Rect goal);
+    // Rebuilds walkable bits for chunks whose tiles changed. If walkability
+    // actually changed, drops cached paths and updates the flow fields and
+    // regions.
+    void refresh(const ECS::Map *);
+    struct Request
+    {
+        int request_id;
+        V2 origin;
+        V2 goal;
+    };
+    struct CachedPath
+    {
+        std::vector<V2> path;
+        bool found;
+    };
+    ECS::Bitmap walkable;
+    std::vector<unsigned int> chunk_versions;
+    std::unordered_map<uint64_t, Path::Manager::CachedPath> cache;
+    std::vector<Path::Manager::Request> requests;
+    std::vector<std::unique_ptr<Path::FlowField>> flow_fields;
+    Path::Regions regions;
+    unsigned int flow_field_clock;
+    int cache_hits;
+    int cache_misses;
+
+private:
+    uint64_t cache_key(V2 origin, V2 goal) const;
+};
+}; // namespace Path
+
+#endif
@@ -1,20 +1,177 @@
 #include "Render.h"
 #include "Assets.h"
+#include "Atlas.h"
 #include "Window.h"
 #include "SDLWrapper.h"
 #include "MessageBus.h"
 #include <stdio.h>
 #include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <assert.h>
 
-static Render::Event render_queue[RENDER_QUEUE_SIZE];
-static Render::Event world_layer_buffer[RENDER_QUEUE_SIZE];
-static Render::Event gui_layer_buffer[RENDER_QUEUE_SIZE];
-static int render_queue_length = 0;
+// Events are written straight into their layer's stream and drawn from there.
+// Streams only ever grow, so once they're big enough for the busiest frame
+// they don't allocate again.
+struct CommandStream
+{
+    std::vector<Render::Event> events;
+    int length;
+};
+static CommandStream command_streams[2] = {
+    {std::vector<Render::Event>(RENDER_QUEUE_SIZE), 0},
+    {std::vector<Render::Event>(RENDER_QUEUE_SIZE), 0}};
+static int high_water_mark = 0;
 static BlankTexture *blank_texture = nullptr;
 
+struct CachedTexture
+{
+    BlankTexture *texture;
+    unsigned int version;
+    int last_used_frame;
+};
+struct BakeRequest
+{
+    int key;
+    unsigned int version;
+    V2 dimensions;
+    int begin;
+    int end;
+};
+static std::unordered_map<int, CachedTexture> texture_cache;
+static std::vector<BakeRequest> bake_requests;
+static std::vector<Render::Event> bake_queue;
+static int cache_budget = 16;
+static int frame_count = 0;
+
+// Scratch for sorting, kept between frames like the command streams.
+static std::vector<uint64_t> sort_keys;
+static std::vector<uint64_t> sort_keys_scratch;
+static std::vector<int> sort_order;
+static std::vector<int> sort_order_scratch;
+
+static uint64_t clamp_key_field(int value, int bits)
+{
+    int64_t biased = static_cast<int64_t>(value) + (INT64_C(1) << (bits - 1));
+    return static_cast<uint64_t>(std::min(std::max(biased, INT64_C(0)), (INT64_C(1) << bits) - 1));
+}
+
+// Images on the same atlas page share an id so they sort next to each other.
+// 0 means no texture.
+static int texture_batch_id(int texture_index)
+{
+    auto texture_table = Assets::get_texture_table();
+    if (texture_index < 0 || texture_index >= static_cast<int>(texture_table->size()))
+    {
+        return 0;
+    }
+    Texture *texture = texture_table->at(texture_index).get();
+    if (texture != nullptr && texture->page != -1)
+    {
+        return 1 + texture->page;
+    }
+    return std::min(1 + Atlas::MAX_PAGES + texture_index, 0xFFFF);
+}
+
+// Bit 63 is the layer, then 16 bits of z_index, 24 bits of y position and 16
+// bits of texture batch id. GUI elements at the same z_index often overlap
+// each other, so the GUI layer keeps submission order instead of sorting by
+// y and texture.
+static uint64_t make_sort_key(const Render::Event &e)
+{
+    uint64_t key = static_cast<uint64_t>(e.layer) << 63 | clamp_key_field(e.z_index, 16) << 47;
+    if (e.layer == Render::Layer::GUI_LAYER)
+    {
+        return key;
+    }
+    int y = 0;
+    int texture_index = -1;
+    switch (e.type)
+    {
+    case Render::EventType::RENDER_RECTANGLE:
+    {
+        y = e.data.render_rectangle_event.box.y;
+        break;
+    }
+    case Render::EventType::RENDER_TEXTURE:
+    {
+        y = e.data.render_texture_event.position.y;
+        texture_index = e.data.render_texture_event.texture_index;
+        break;
+    }
+    case Render::EventType::RENDER_LINE:
+    {
+        y = std::min(e.data.render_line_event.start.y, e.data.render_line_event.end.y);
+        break;
+    }
+    case Render::EventType::RENDER_CACHED_TEXTURE:
+    {
+        y = e.data.render_cached_texture_event.position.y;
+        break;
+    }
+    }
+    return key | clamp_key_field(y, 24) << 23 | static_cast<uint64_t>(texture_batch_id(texture_index)) << 7;
+}
+
+// Stable LSD radix sort of the events' keys, a byte at a time, skipping bytes
+// every key shares. Returns the event indices in draw order.
+static const int *sort_render_events(const Render::Event *render_events, int length)
+{
+    if (static_cast<int>(sort_keys.size()) < length)
+    {
+        sort_keys.resize(length);
+        sort_keys_scratch.resize(length);
+        sort_order.resize(length);
+        sort_order_scratch.resize(length);
+    }
+    for (int i = 0; i < length; ++i)
+    {
+        sort_keys[i] = render_events[i].sort_key;
+        sort_order[i] = i;
+    }
+    for (int shift = 0; shift < 64 && length > 1; shift += 8)
+    {
+        int counts[256] = {};
+        for (int i = 0; i < length; ++i)
+        {
+            ++counts[(sort_keys[i] >> shift) & 0xFF];
+        }
+        if (counts[(sort_keys[0] >> shift) & 0xFF] == length)
+        {
+            continue;
+        }
+        int offset = 0;
+        for (int digit = 0; digit < 256; ++digit)
+        {
+            int count = counts[digit];
+            counts[digit] = offset;
+            offset += count;
+        }
+        for (int i = 0; i < length; ++i)
+        {
+            int slot = counts[(sort_keys[i] >> shift) & 0xFF]++;
+            sort_keys_scratch[slot] = sort_keys[i];
+            sort_order_scratch[slot] = sort_order[i];
+        }
+        sort_keys.swap(sort_keys_scratch);
+        sort_order.swap(sort_order_scratch);
+    }
+    return sort_order.data();
+}
+
+static Render::Event *push_event(Render::Layer layer)
+{
+    CommandStream *stream = &command_streams[layer];
+    if (stream->length == static_cast<int>(stream->events.size()))
+    {
+        stream->events.resize(stream->events.size() * 2);
+    }
+    return &stream->events[stream->length++];
+}
+
 void Render::render_texture(Render::Layer layer, int texture_index, V2 &position, Rect *overflow_clip, int scale, int z_index)
 {
-    Render::Event e;
+    Render::Event &e = *push_event(layer);
     e.layer = layer;
     e.type = Render::EventType::RENDER_TEXTURE;
     if (overflow_clip == nullptr)
@@ -28,12 +185,12 @@ void Render::render_texture(Render::Layer layer, int texture_index, V2 &position
     }
     e.z_index = z_index;
     e.data.render_texture_event = {{}, position, texture_index, scale, false};
-    render_queue[render_queue_length++] = e;
+    e.sort_key = make_sort_key(e);
 }
 
 void Render::render_texture(Render::Layer layer, int texture_index, Rect &clip, V2 &position, Rect *overflow_clip, int scale, int z_index)
 {
-    Render::Event e;
+    Render::Event &e = *push_event(layer);
     e.layer = layer;
     e.type = Render::EventType::RENDER_TEXTURE;
     if (overflow_clip == nullptr)
@@ -48,18 +205,18 @@ void Render::render_texture(Render::Layer layer, int texture_index, Rect &clip,
     e.z_index = z_index;
     e.has_overflow_clip = false;
     e.data.render_texture_event = {clip, position, texture_index, scale, true};
-    render_queue[render_queue_length++] = e;
+    e.sort_key = make_sort_key(e);
 }
 
 void Render::render_rectangle(Render::Layer layer, const Rect &box, const Color &color, bool filled, int z_index)
 {
-    Render::Event e;
+    Render::Event &e = *push_event(layer);
     e.layer = layer;
     e.type = Render::EventType::RENDER_RECTANGLE;
     e.has_overflow_clip = false;
     e.z_index = z_index;
     e.data.render_rectangle_event = {box, color, filled};
-    render_queue[render_queue_length++] = e;
+    e.sort_key = make_sort_key(e);
 }
 
 void Render::render_line(
@@ -69,37 +226,343 @@ void Render::render_line(
     Color *color,
     int z_index)
 {
-    Render::Event e;
+    Render::Event &e = *push_event(layer);
     e.layer = layer;
     e.type = Render::EventType::RENDER_LINE;
     e.has_overflow_clip = false;
     e.z_index = z_index;
     e.data.render_line_event = {*start, *end, *color};
-    render_queue[render_queue_length++] = e;
+    e.sort_key = make_sort_key(e);
+}
+
+bool Render::is_cached(int key, unsigned int version)
+{
+    auto it = texture_cache.find(key);
+    return it != texture_cache.end() && it->second.version == version && it->second.texture != nullptr;
 }
 
-bool compare_render_events(Render::Event a, Render::Event b)
+void Render::begin_bake(int key, unsigned int version, V2 dimensions)
 {
-    return a.z_index < b.z_index;
+    assert(bake_requests.empty() || bake_requests.back().end != -1);
+    bake_requests.push_back({key, version, dimensions, static_cast<int>(bake_queue.size()), -1});
 }
 
-void _perform_render(SDL_Renderer *renderer, const Render::Event *render_events, int length)
+void Render::bake_texture(int texture_index, Rect &clip, V2 &position, int scale, int z_index)
+{
+    assert(!bake_requests.empty() && bake_requests.back().end == -1);
+    Render::Event e;
+    e.layer = Render::Layer::WORLD_LAYER;
+    e.type = Render::EventType::RENDER_TEXTURE;
+    e.has_overflow_clip = false;
+    e.z_index = z_index;
+    e.data.render_texture_event = {clip, position, texture_index, scale, true};
+    e.sort_key = make_sort_key(e);
+    bake_queue.push_back(e);
+}
+
+void Render::end_bake()
+{
+    assert(!bake_requests.empty() && bake_requests.back().end == -1);
+    bake_requests.back().end = bake_queue.size();
+}
+
+void Render::render_cached_texture(Render::Layer layer, int key, V2 &position, int z_index)
+{
+    Render::Event &e = *push_event(layer);
+    e.layer = layer;
+    e.type = Render::EventType::RENDER_CACHED_TEXTURE;
+    e.has_overflow_clip = false;
+    e.z_index = z_index;
+    e.data.render_cached_texture_event = {key, position};
+    e.sort_key = make_sort_key(e);
+}
+
+void Render::set_cache_budget(int max_textures)
+{
+    cache_budget = std::max(max_textures, 1);
+}
+
+static void evict_cached_textures()
+{
+    // Never evict something drawn this frame, even if that means going over
+    // budget for a frame.
+    while (static_cast<int>(texture_cache.size()) > cache_budget)
+    {
+        auto oldest = texture_cache.end();
+        for (auto it = texture_cache.begin(); it != texture_cache.end(); ++it)
+        {
+            if (it->second.last_used_frame < frame_count &&
+                (oldest == texture_cache.end() || it->second.last_used_frame < oldest->second.last_used_frame))
+            {
+                oldest = it;
+            }
+        }
+        if (oldest == texture_cache.end())
+        {
+            return;
+        }
+        delete oldest->second.texture;
+        texture_cache.erase(oldest);
+    }
+}
+
+static int draw_calls = 0;
+
+// The renderer state Render last set, so calls that wouldn't change anything
+// can be skipped. SDL keeps a clip rect and scale per render target, so those
+// are forgotten whenever the target changes.
+struct RendererState
+{
+    bool target_known;
+    SDL_Texture *target;
+    bool clip_known;
+    bool clipped;
+    Rect clip;
+    bool draw_color_known;
+    Color draw_color;
+    bool blend_mode_known;
+    SDL_BlendMode blend_mode;
+    bool scale_known;
+    float scale;
+    int issued;
+    int elided;
+};
+static RendererState renderer_state = {};
+
+// Called at the start of each frame in case anything else touched the
+// renderer, and whenever a texture that could be the target is destroyed.
+static void forget_renderer_state()
+{
+    renderer_state.target_known = false;
+    renderer_state.clip_known = false;
+    renderer_state.draw_color_known = false;
+    renderer_state.blend_mode_known = false;
+    renderer_state.scale_known = false;
+}
+
+static void set_render_target(SDL_Renderer *renderer, SDL_Texture *target)
+{
+    if (renderer_state.target_known && renderer_state.target == target)
+    {
+        ++renderer_state.elided;
+        return;
+    }
+    ++renderer_state.issued;
+    SDL_SetRenderTarget(renderer, target);
+    renderer_state.target_known = true;
+    renderer_state.target = target;
+    renderer_state.clip_known = false;
+    renderer_state.scale_known = false;
+}
+
+static void set_clip_rect(SDL_Renderer *renderer, const Rect *clip)
+{
+    if (renderer_state.clip_known && renderer_state.clipped == (clip != nullptr) &&
+        (clip == nullptr || (renderer_state.clip.x == clip->x && renderer_state.clip.y == clip->y &&
+                             renderer_state.clip.w == clip->w && renderer_state.clip.h == clip->h)))
+    {
+        ++renderer_state.elided;
+        return;
+    }
+    ++renderer_state.issued;
+    SDL_RenderSetClipRect(renderer, clip);
+    renderer_state.clip_known = true;
+    renderer_state.clipped = clip != nullptr;
+    if (clip != nullptr)
+    {
+        renderer_state.clip = *clip;
+    }
+}
+
+static void set_draw_color(SDL_Renderer *renderer, const Color &color)
+{
+    if (renderer_state.draw_color_known && renderer_state.draw_color.r == color.r && renderer_state.draw_color.g == color.g &&
+        renderer_state.draw_color.b == color.b && renderer_state.draw_color.a == color.a)
+    {
+        ++renderer_state.elided;
+        return;
+    }
+    ++renderer_state.issued;
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    renderer_state.draw_color_known = true;
+    renderer_state.draw_color = color;
+}
+
+static void set_draw_blend_mode(SDL_Renderer *renderer, SDL_BlendMode blend_mode)
+{
+    if (renderer_state.blend_mode_known && renderer_state.blend_mode == blend_mode)
+    {
+        ++renderer_state.elided;
+        return;
+    }
+    ++renderer_state.issued;
+    SDL_SetRenderDrawBlendMode(renderer, blend_mode);
+    renderer_state.blend_mode_known = true;
+    renderer_state.blend_mode = blend_mode;
+}
+
+static void set_render_scale(SDL_Renderer *renderer, float scale)
+{
+    if (renderer_state.scale_known && renderer_state.scale == scale)
+    {
+        ++renderer_state.elided;
+        return;
+    }
+    ++renderer_state.issued;
+    SDL_RenderSetScale(renderer, scale, scale);
+    renderer_state.scale_known = true;
+    renderer_state.scale = scale;
+}
+
+// Consecutive unclipped sprites from the same SDL texture (an atlas page can
+// hold many images) are gathered into a run. With SDL 2.0.18 or newer a run is
+// one mesh drawn with a single SDL_RenderGeometry call. Otherwise, or if the
+// renderer rejects geometry, the run is drawn as back to back SDL_RenderCopy
+// calls on that one texture, which SDL's render batching (see SDLWrapper)
+// queues up and binds the texture for once.
+struct BatchedSprite
+{
+    Texture *texture;
+    const Render::Event *event;
+};
+struct SpriteBatch
+{
+    SDL_Texture *texture;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+#endif
+    std::vector<BatchedSprite> sprites;
+};
+static SpriteBatch sprite_batch = {};
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+static bool geometry_supported = true;
+#endif
+static int sprite_batches = 0;
+
+// Same quad as Texture::render, without the rotation and flip RenderCopyEx
+// would have to check for.
+static void copy_sprite(SDL_Renderer *renderer, const BatchedSprite &sprite)
+{
+    const Render::RenderTextureEvent &event = sprite.event->data.render_texture_event;
+    Rect clip = event.has_clip ? event.clip : Rect{0, 0, sprite.texture->dimensions.x, sprite.texture->dimensions.y};
+    SDL_Rect source = {sprite.texture->region.x + clip.x, sprite.texture->region.y + clip.y, clip.w, clip.h};
+    SDL_Rect render_quad = {event.position.x, event.position.y, clip.w * event.scale, clip.h * event.scale};
+    SDL_RenderCopy(renderer, sprite.texture->texture, &source, &render_quad);
+    ++draw_calls;
+}
+
+static void flush_sprite_batch(SDL_Renderer *renderer)
+{
+    if (sprite_batch.sprites.empty())
+    {
+        return;
+    }
+    set_clip_rect(renderer, nullptr);
+    ++sprite_batches;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    if (geometry_supported)
+    {
+        ++draw_calls;
+        if (SDL_RenderGeometry(
+                renderer,
+                sprite_batch.texture,
+                sprite_batch.vertices.data(),
+                sprite_batch.vertices.size(),
+                sprite_batch.indices.data(),
+                sprite_batch.indices.size()) < 0)
+        {
+            printf("Warning: SDL_RenderGeometry failed, drawing sprites one at a time: %s\n", SDL_GetError());
+            geometry_supported = false;
+        }
+    }
+    if (!geometry_supported)
+    {
+        for (const BatchedSprite &sprite : sprite_batch.sprites)
+        {
+            copy_sprite(renderer, sprite);
+        }
+    }
+    sprite_batch.vertices.clear();
+    sprite_batch.indices.clear();
+#else
+    for (const BatchedSprite &sprite : sprite_batch.sprites)
+    {
+        copy_sprite(renderer, sprite);
+    }
+#endif
+    sprite_batch.sprites.clear();
+}
+
+// Returns false if the sprite has to be drawn on its own.
+static bool batch_sprite(SDL_Renderer *renderer, Texture *texture, const Render::Event &e)
+{
+    if (e.has_overflow_clip || texture->texture == nullptr)
+    {
+        return false;
+    }
+    if (texture->texture != sprite_batch.texture)
+    {
+        flush_sprite_batch(renderer);
+        sprite_batch.texture = texture->texture;
+    }
+    sprite_batch.sprites.push_back({texture, &e});
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    if (!geometry_supported)
+    {
+        return true;
+    }
+    // Same quad as Texture::render.
+    const Render::RenderTextureEvent &sprite = e.data.render_texture_event;
+    Rect clip = sprite.has_clip ? sprite.clip : Rect{0, 0, texture->dimensions.x, texture->dimensions.y};
+    float left = sprite.position.x;
+    float top = sprite.position.y;
+    float right = left + clip.w * sprite.scale;
+    float bottom = top + clip.h * sprite.scale;
+    float u0 = static_cast<float>(texture->region.x + clip.x) / texture->texture_dimensions.x;
+    float v0 = static_cast<float>(texture->region.y + clip.y) / texture->texture_dimensions.y;
+    float u1 = static_cast<float>(texture->region.x + clip.x + clip.w) / texture->texture_dimensions.x;
+    float v1 = static_cast<float>(texture->region.y + clip.y + clip.h) / texture->texture_dimensions.y;
+    SDL_Color white = {0xFF, 0xFF, 0xFF, 0xFF};
+    int first = sprite_batch.vertices.size();
+    sprite_batch.vertices.push_back({{left, top}, white, {u0, v0}});
+    sprite_batch.vertices.push_back({{right, top}, white, {u1, v0}});
+    sprite_batch.vertices.push_back({{right, bottom}, white, {u1, v1}});
+    sprite_batch.vertices.push_back({{left, bottom}, white, {u0, v1}});
+    int quad[6] = {first, first + 1, first + 2, first, first + 2, first + 3};
+    sprite_batch.indices.insert(sprite_batch.indices.end(), quad, quad + 6);
+#endif
+    return true;
+}
+
+bool Render::batches_geometry()
+{
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    return geometry_supported;
+#else
+    return false;
+#endif
+}
+
+// Draws the events in sort key order.
+void _perform_render(SDL_Renderer *renderer, Render::Event *render_events, int length)
 {
     auto texture_table = Assets::get_texture_table();
-    std::vector<Render::Event> render_vector(render_events, render_events + length);
-    std::sort(render_vector.begin(), render_vector.end(), compare_render_events);
-    for (Render::Event &e : render_vector)
+    const int *order = sort_render_events(render_events, length);
+    for (int i = 0; i < length; ++i)
     {
+        Render::Event &e = render_events[order[i]];
+        if (e.type != Render::EventType::RENDER_TEXTURE)
+        {
+            flush_sprite_batch(renderer);
+        }
         switch (e.type)
         {
         case Render::EventType::RENDER_LINE:
         {
-            SDL_SetRenderDrawColor(
-                renderer,
-                e.data.render_line_event.color.r,
-                e.data.render_line_event.color.g,
-                e.data.render_line_event.color.b,
-                e.data.render_line_event.color.a);
+            set_clip_rect(renderer, nullptr);
+            set_draw_color(renderer, e.data.render_line_event.color);
+            ++draw_calls;
             SDL_RenderDrawLine(
                 renderer,
                 e.data.render_line_event.start.x,
@@ -110,16 +573,9 @@ void _perform_render(SDL_Renderer *renderer, const Render::Event *render_events,
         }
         case Render::EventType::RENDER_RECTANGLE:
         {
-            if (e.has_overflow_clip)
-            {
-                SDL_RenderSetClipRect(renderer, &e.overflow_clip);
-            }
-            SDL_SetRenderDrawColor(
-                renderer,
-                e.data.render_rectangle_event.color.r,
-                e.data.render_rectangle_event.color.g,
-                e.data.render_rectangle_event.color.b,
-                e.data.render_rectangle_event.color.a);
+            set_clip_rect(renderer, e.has_overflow_clip ? &e.overflow_clip : nullptr);
+            set_draw_color(renderer, e.data.render_rectangle_event.color);
+            ++draw_calls;
             if (e.data.render_rectangle_event.filled)
             {
                 SDL_RenderFillRect(renderer, &e.data.render_rectangle_event.box);
@@ -128,14 +584,13 @@ void _perform_render(SDL_Renderer *renderer, const Render::Event *render_events,
             {
                 SDL_RenderDrawRect(renderer, &e.data.render_rectangle_event.box);
             }
-            SDL_RenderSetClipRect(renderer, nullptr);
             break;
         }
         case Render::EventType::RENDER_TEXTURE:
         {
             if (e.has_overflow_clip)
             {
-                SDL_RenderSetClipRect(renderer, &e.overflow_clip);
+                flush_sprite_batch(renderer);
             }
             int texture_index = e.data.render_texture_event.texture_index;
             if (texture_index >= 0 && texture_index < static_cast<int>(texture_table->size()))
@@ -144,52 +599,100 @@ void _perform_render(SDL_Renderer *renderer, const Render::Event *render_events,
                 if (texture == nullptr)
                 {
                     printf("Error: RenderSystem received event with texture index to nullptr: %d\n", texture_index);
-                    SDL_RenderSetClipRect(renderer, nullptr);
                     break;
                 }
+                if (batch_sprite(renderer, texture, e))
+                {
+                    break;
+                }
+                flush_sprite_batch(renderer);
+                set_clip_rect(renderer, e.has_overflow_clip ? &e.overflow_clip : nullptr);
                 Rect *clip = nullptr;
                 if (e.data.render_texture_event.has_clip)
                 {
                     clip = &e.data.render_texture_event.clip;
                 }
+                ++draw_calls;
                 texture->render(renderer, e.data.render_texture_event.position, clip, e.data.render_texture_event.scale);
             }
-            SDL_RenderSetClipRect(renderer, nullptr);
             break;
         }
+        case Render::EventType::RENDER_CACHED_TEXTURE:
+        {
+            auto it = texture_cache.find(e.data.render_cached_texture_event.key);
+            if (it == texture_cache.end() || it->second.texture == nullptr)
+            {
+                break;
+            }
+            it->second.last_used_frame = frame_count;
+            set_clip_rect(renderer, nullptr);
+            ++draw_calls;
+            it->second.texture->render(renderer, e.data.render_cached_texture_event.position);
+            break;
+        }
+        }
+    }
+    flush_sprite_batch(renderer);
+}
+
+static void perform_bakes(SDL_Renderer *renderer)
+{
+    for (BakeRequest &request : bake_requests)
+    {
+        assert(request.end != -1);
+        CachedTexture *cached = &texture_cache[request.key];
+        if (cached->texture != nullptr &&
+            (cached->texture->dimensions.x != request.dimensions.x || cached->texture->dimensions.y != request.dimensions.y))
+        {
+            delete cached->texture;
+            cached->texture = nullptr;
+            forget_renderer_state();
+        }
+        if (cached->texture == nullptr)
+        {
+            cached->texture = new BlankTexture(renderer, request.dimensions, SDL_TEXTUREACCESS_TARGET);
+            SDL_SetTextureBlendMode(cached->texture->texture, SDL_BLENDMODE_BLEND);
         }
+        cached->version = request.version;
+        cached->last_used_frame = frame_count;
+        set_render_target(renderer, cached->texture->texture);
+        set_draw_color(renderer, {0x00, 0x00, 0x00, 0x00});
+        SDL_RenderClear(renderer);
+        _perform_render(renderer, bake_queue.data() + request.begin, request.end - request.begin);
     }
+    bake_requests.clear();
+    bake_queue.clear();
+    set_render_target(renderer, nullptr);
 }
 
 void Render::perform_render()
 {
+    CommandStream *world_stream = &command_streams[Render::Layer::WORLD_LAYER];
+    CommandStream *gui_stream = &command_streams[Render::Layer::GUI_LAYER];
+    int queue_length = world_stream->length + gui_stream->length;
+    high_water_mark = std::max(high_water_mark, queue_length);
     {
         // DEBUG
         MBus::Message debug;
         debug.type = MBus::MESSAGES_IN_RENDER_QUEUE;
-        debug.data.mirq.num = render_queue_length;
+        debug.data.mirq.num = queue_length;
+        MBus::send_debug_message(&debug);
+        debug.type = MBus::RENDER_QUEUE_HIGH_WATER_MARK;
+        debug.data.rqhwm.num = high_water_mark;
         MBus::send_debug_message(&debug);
     }
     double world_render_scale = Window::get_world_render_scale();
     double gui_render_scale = Window::get_gui_render_scale();
-    int world_buffer_length = 0;
-    int gui_buffer_length = 0;
-    for (int i = 0; i < render_queue_length; ++i)
-    {
-        Render::Event e = render_queue[i];
-        if (e.layer == Render::Layer::GUI_LAYER)
-        {
-            gui_layer_buffer[gui_buffer_length] = e;
-            ++gui_buffer_length;
-        }
-        else
-        {
-            world_layer_buffer[world_buffer_length] = e;
-            ++world_buffer_length;
-        }
-    }
-    render_queue_length = 0;
     auto renderer = SDL::get_renderer();
+    ++frame_count;
+    draw_calls = 0;
+    sprite_batches = 0;
+    renderer_state.issued = 0;
+    renderer_state.elided = 0;
+    forget_renderer_state();
+    set_draw_blend_mode(renderer, SDL_BLENDMODE_BLEND);
+    set_render_scale(renderer, 1.0);
+    perform_bakes(renderer);
     V2 *window = Window::get_window();
     if (blank_texture == nullptr)
     {
@@ -201,22 +704,37 @@ void Render::perform_render()
     else if (blank_texture->dimensions.x != window->x || blank_texture->dimensions.y != window->y)
     {
         delete blank_texture;
+        forget_renderer_state();
         V2 dimensions = {
             window->x,
             window->y};
         blank_texture = new BlankTexture(renderer, dimensions, SDL_TEXTUREACCESS_TARGET);
     }
-    SDL_SetRenderTarget(renderer, blank_texture->texture);
-    SDL_RenderSetScale(renderer, 1.0, 1.0);
-    SDL_SetRenderDrawColor(renderer, 0x11, 0x11, 0x11, 0xFF);
+    set_render_target(renderer, blank_texture->texture);
+    set_render_scale(renderer, 1.0);
+    set_draw_color(renderer, {0x11, 0x11, 0x11, 0xFF});
     SDL_RenderClear(renderer);
 
-    _perform_render(renderer, world_layer_buffer, world_buffer_length);
-    SDL_SetRenderTarget(renderer, nullptr);
+    _perform_render(renderer, world_stream->events.data(), world_stream->length);
+    set_render_target(renderer, nullptr);
+    set_clip_rect(renderer, nullptr);
     blank_texture->render(renderer, {0, 0}, world_render_scale);
 
-    SDL_RenderSetScale(renderer, gui_render_scale, gui_render_scale);
-    _perform_render(renderer, gui_layer_buffer, gui_buffer_length);
+    set_render_scale(renderer, gui_render_scale);
+    _perform_render(renderer, gui_stream->events.data(), gui_stream->length);
+    world_stream->length = 0;
+    gui_stream->length = 0;
+    {
+        // DEBUG
+        MBus::Message debug;
+        debug.type = MBus::DRAW_CALLS;
+        debug.data.dc = {draw_calls, sprite_batches};
+        MBus::send_debug_message(&debug);
+        debug.type = MBus::RENDER_STATE_CHANGES;
+        debug.data.rsc = {renderer_state.issued, renderer_state.elided};
+        MBus::send_debug_message(&debug);
+    }
 
     SDL_RenderPresent(renderer);
+    evict_cached_textures();
 }
\ No newline at end of file
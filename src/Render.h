@@ -2,7 +2,9 @@
 #define RENDER_h_
 
 #include "GameTypes.h"
+#include <stdint.h>
 
+// Starting number of events per layer. The queue grows past this as needed.
 const static int RENDER_QUEUE_SIZE = 16384;
 
 namespace Render
@@ -25,7 +27,8 @@ enum EventType
 {
     RENDER_RECTANGLE,
     RENDER_TEXTURE,
-    RENDER_LINE
+    RENDER_LINE,
+    RENDER_CACHED_TEXTURE
 };
 struct RenderRectangleEvent
 {
@@ -49,6 +52,11 @@ struct RenderTextureEvent
     int scale;
     bool has_clip;
 };
+struct RenderCachedTextureEvent
+{
+    int key;
+    V2 position;
+};
 struct Event
 {
     Render::Layer layer;
@@ -56,10 +64,15 @@ struct Event
     Rect overflow_clip;
     bool has_overflow_clip;
     int z_index;
+    // Draw order, filled in on submit: layer, then z_index, then (world layer
+    // only) y position and texture. Events with equal keys draw in the order
+    // they were submitted.
+    uint64_t sort_key;
     union {
         Render::RenderRectangleEvent render_rectangle_event;
         Render::RenderTextureEvent render_texture_event;
         Render::RenderLineEvent render_line_event;
+        Render::RenderCachedTextureEvent render_cached_texture_event;
     } data;
 };
 void render_texture(
@@ -89,6 +102,22 @@ void render_line(
     V2 *end,
     Color *color,
     int z_index = 1);
+// Cached textures hold static content (e.g. a map chunk's tiles) that is
+// drawn once into an offscreen texture and then blitted as a single quad for
+// as long as its version stays the same. Between begin_bake and end_bake,
+// bake_texture draws into the cached texture using coordinates relative to
+// its top left corner. Baking happens at the start of perform_render.
+bool is_cached(int key, unsigned int version);
+void begin_bake(int key, unsigned int version, V2 dimensions);
+void bake_texture(int texture_index, Rect &clip, V2 &position, int scale = 1, int z_index = 1);
+void end_bake();
+void render_cached_texture(Render::Layer layer, int key, V2 &position, int z_index = 1);
+// Least recently used cached textures beyond this count are destroyed.
+// ECS::render_tiles sizes it every frame from the camera.
+void set_cache_budget(int max_textures);
+// Whether a run of sprites from one texture goes out as a single
+// SDL_RenderGeometry call rather than one copy per sprite.
+bool batches_geometry();
 void perform_render();
 }; // namespace Render
 
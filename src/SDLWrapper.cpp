@@ -20,6 +20,13 @@ bool SDL::initialize_SDL(size_t screenWidth, size_t screenHeight, bool _vsync)
         {
             printf("Warning: Linear texture filtering not enabled!");
         }
+        // Lets SDL queue up draws and only bind a texture once for a run of
+        // copies from it, which is how Render draws sprite runs when
+        // SDL_RenderGeometry isn't available.
+        if (!SDL_SetHint(SDL_HINT_RENDER_BATCHING, "1"))
+        {
+            printf("Warning: Render batching not enabled!");
+        }
 
         window = SDL_CreateWindow("2D Engine Prototype", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, screenWidth, screenHeight, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
         if (window == NULL)
@@ -0,0 +1,94 @@
+#include "Scheduler.h"
+#include <assert.h>
+
+static bool systems_conflict(const ECS::System *a, const ECS::System *b)
+{
+    return (a->writes & (b->reads | b->writes)) != 0 || (b->writes & a->reads) != 0;
+}
+
+static void run_system_job(void *data, int system_index, int)
+{
+    static_cast<ECS::Scheduler *>(data)->execute(system_index);
+}
+
+ECS::Scheduler::Scheduler() : frame_manager(nullptr), frame_ts(0), graph_dirty(true){};
+
+int ECS::Scheduler::add_system(const ECS::System &system)
+{
+    assert(system.function != nullptr);
+    this->systems.push_back(system);
+    this->graph_dirty = true;
+    return this->systems.size() - 1;
+}
+
+void ECS::Scheduler::build_graph()
+{
+    int count = this->systems.size();
+    this->dependents.assign(count, std::vector<int>());
+    this->dependency_counts.assign(count, 0);
+    this->pending.reset(new std::atomic<int>[count]);
+    for (int i = 0; i < count; ++i)
+    {
+        for (int j = i + 1; j < count; ++j)
+        {
+            if (systems_conflict(&this->systems[i], &this->systems[j]))
+            {
+                this->dependents[i].push_back(j);
+                ++this->dependency_counts[j];
+            }
+        }
+    }
+    this->graph_dirty = false;
+}
+
+void ECS::Scheduler::run(ECS::Manager *manager, double ts)
+{
+    if (this->graph_dirty)
+    {
+        this->build_graph();
+    }
+    this->frame_manager = manager;
+    this->frame_ts = ts;
+    int count = this->systems.size();
+    for (int i = 0; i < count; ++i)
+    {
+        this->pending[i] = this->dependency_counts[i];
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        if (this->dependency_counts[i] == 0)
+        {
+            this->dispatch(i);
+        }
+    }
+    Jobs::wait(&this->frame_counter);
+}
+
+void ECS::Scheduler::execute(int system_index)
+{
+    this->systems[system_index].function(this->frame_manager, this->frame_ts);
+    for (int dependent : this->dependents[system_index])
+    {
+        if (--this->pending[dependent] == 0)
+        {
+            this->dispatch(dependent);
+        }
+    }
+}
+
+void ECS::Scheduler::dispatch(int system_index)
+{
+    Jobs::Job job;
+    job.function = run_system_job;
+    job.data = this;
+    job.begin = system_index;
+    job.end = system_index + 1;
+    if (this->systems[system_index].main_thread)
+    {
+        Jobs::run_on_main_thread(job, &this->frame_counter);
+    }
+    else
+    {
+        Jobs::run(job, &this->frame_counter);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef SCHEDULER_h_
+#define SCHEDULER_h_
+
+#include "Jobs.h"
+#include <vector>
+#include <memory>
+#include <atomic>
+
+namespace ECS
+{
+struct Manager;
+
+// Shared state that systems touch outside of components. These sit above the
+// component flags so a single mask describes everything a system reads or
+// writes.
+const static int INPUT_RESOURCE = 1 << 16;
+const static int CAMERA_RESOURCE = 1 << 17;
+const static int MAP_RESOURCE = 1 << 18;
+// Everything behind Render's submit calls: the command streams, the bake
+// cache and the asset tables sort keys are built from. Any system that
+// submits render events writes it.
+const static int RENDER_RESOURCE = 1 << 19;
+const static int DEBUG_BUS_RESOURCE = 1 << 20;
+const static int SPATIAL_INDEX_RESOURCE = 1 << 21;
+// Storage::change_tick. Systems that call bump_tick write it; systems that
+// write components (which stamps rows with the tick) read it.
+const static int STORAGE_TICK_RESOURCE = 1 << 22;
+
+typedef void (*SystemFunction)(ECS::Manager *, double ts);
+struct System
+{
+    const char *name;
+    SystemFunction function;
+    int reads;
+    int writes;
+    // For systems that have to stay on the SDL thread.
+    bool main_thread;
+};
+
+// Runs registered systems once per frame. Two systems conflict when one
+// writes something the other reads or writes; conflicting systems run in the
+// order they were added and everything else runs in parallel on the job
+// system.
+struct Scheduler
+{
+    Scheduler();
+    int add_system(const ECS::System &);
+    void run(ECS::Manager *, double ts);
+    void execute(int system_index);
+    std::vector<ECS::System> systems;
+    // dependents[i] are the systems waiting on system i.
+    std::vector<std::vector<int>> dependents;
+    std::vector<int> dependency_counts;
+    std::unique_ptr<std::atomic<int>[]> pending;
+    Jobs::Counter frame_counter;
+    ECS::Manager *frame_manager;
+    double frame_ts;
+    bool graph_dirty;
+
+private:
+    void build_graph();
+    void dispatch(int system_index);
+};
+
+void add_core_systems(ECS::Scheduler *);
+
+}; // namespace ECS
+
+#endif
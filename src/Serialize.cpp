@@ -20,47 +20,54 @@ bool Serialize::save_game(ECS::Manager *entity_manager, std::string file)
     picojson::value::array entity_array;
 
     // Serialize Map
-    for (int i = 0; i < map->dimensions.x; ++i)
-    {
-        for (int j = 0; j < map->dimensions.y; ++j)
+    map->grid.each_cell([map, &tiles](V2 grid_position, const ECS::Cell *cell) {
+        bool wrote_entity = false;
+        for (int layer = 0; layer < ECS::NUM_TILE_LAYERS; ++layer)
         {
-            ECS::Tile tile = map->grid[i][j].tile;
+            if (cell->tiles[layer] == 0)
+            {
+                continue;
+            }
+            const ECS::Entity *prototype = ECS::get_prototype(cell->tiles[layer] - 1);
             picojson::object tile_object;
-            if (!tile.empty)
+            picojson::array tile_entity_components_array;
+            for (int i = 0; i < prototype->component_length; ++i)
             {
-                picojson::object clip;
-                picojson::array tile_entity_components_array;
-                for (int i = 0; i < tile.tile_entity.component_length; ++i)
-                {
-                    picojson::object component_object = ECS::jsonize_component(
-                        tile.tile_entity.components[i].type,
-                        &tile.tile_entity.components[i]);
-                    tile_entity_components_array.push_back(picojson::value(component_object));
-                }
-                tile_object["grid_x"] = picojson::value((double)i);
-                tile_object["grid_y"] = picojson::value((double)j);
-                tile_object["component_flags"] = picojson::value((double)tile.tile_entity.component_flags);
-                tile_object["tile_components"] = picojson::value(tile_entity_components_array);
-                if (map->grid[i][j].has_entity)
-                {
-                    tile_object["entity_id"] = picojson::value((double)map->grid[i][j].entity_id);
-                }
-                tiles.push_back(picojson::value(tile_object));
+                ECS::Component component = prototype->components[i];
+                picojson::object component_object = ECS::jsonize_component(component.type, &component);
+                tile_entity_components_array.push_back(picojson::value(component_object));
+            }
+            tile_object["grid_x"] = picojson::value((double)grid_position.x);
+            tile_object["grid_y"] = picojson::value((double)grid_position.y);
+            tile_object["layer"] = picojson::value((double)layer);
+            tile_object["component_flags"] = picojson::value((double)prototype->component_flags);
+            tile_object["tile_components"] = picojson::value(tile_entity_components_array);
+            ECS::EntityHandle entity;
+            if (!wrote_entity && map->grid.get_entity(grid_position, &entity))
+            {
+                tile_object["entity_id"] = picojson::value((double)entity.index);
+                wrote_entity = true;
             }
+            tiles.push_back(picojson::value(tile_object));
         }
-    }
+    });
 
     // Serialize Entities
-    for (unsigned int i = 0; i < entity_manager->entities.size(); ++i)
+    for (int i = 0; i < entity_manager->entities.slot_count(); ++i)
     {
-        ECS::Entity *entity = &entity_manager->entities[i];
+        ECS::EntityHandle handle = entity_manager->entities.get_handle(i);
+        if (!entity_manager->entities.is_alive(handle))
+        {
+            continue;
+        }
+        ECS::Entity entity = entity_manager->entities.make_entity(handle);
         picojson::object entity_object;
         picojson::array components_array;
         entity_object["id"] = picojson::value((double)i);
-        entity_object["component_flags"] = picojson::value((double)entity->component_flags);
-        for (int i = 0; i < entity->component_length; ++i)
+        entity_object["component_flags"] = picojson::value((double)entity.component_flags);
+        for (int i = 0; i < entity.component_length; ++i)
         {
-            picojson::object component_object = ECS::jsonize_component(entity->components[i].type, &entity->components[i]);
+            picojson::object component_object = ECS::jsonize_component(entity.components[i].type, &entity.components[i]);
             components_array.push_back(picojson::value(component_object));
         }
         entity_object["components"] = picojson::value(components_array);
@@ -183,25 +190,17 @@ Serialize::LoadMapResult Serialize::load_game(std::string file)
     }
 
     int cell_size = 32;
-    result.entity_manager.map.grid = new ECS::Cell *[dimensions.x];
-    for (int i = 0; i < dimensions.x; ++i)
-    {
-        result.entity_manager.map.grid[i] = new ECS::Cell[dimensions.y];
-    }
-    for (int i = 0; i < dimensions.x; ++i)
-    {
-        for (int j = 0; j < dimensions.y; ++j)
-        {
-            result.entity_manager.map.grid[i][j].has_entity = false;
-            result.entity_manager.map.grid[i][j].tile.empty = true;
-        }
-    }
+    result.entity_manager.map.grid.resize(dimensions);
     result.entity_manager.map.dimensions = dimensions;
     result.entity_manager.map.cell_size = cell_size;
     result.entity_manager.map.pixel_dimensions = {dimensions.x * cell_size, dimensions.y * cell_size};
     // ******************************************
 
     // ************* TILES *****************
+    std::vector<std::pair<V2, int>> cell_entity_ids;
+    // Tiles are saved with their blueprint's components; identical ones share
+    // one prototype again on load.
+    std::unordered_map<std::string, int> tile_prototype_ids;
     for (picojson::value::array::const_iterator obj_it = tiles_array.begin(); obj_it != tiles_array.end(); ++obj_it)
     {
         if (obj_it->is<picojson::object>())
@@ -234,14 +233,13 @@ Serialize::LoadMapResult Serialize::load_game(std::string file)
                 // ************* EVERYTHING IS VALIDATED *************
                 int grid_x = static_cast<int>(tile_object["grid_x"].get<double>());
                 int grid_y = static_cast<int>(tile_object["grid_y"].get<double>());
-                int component_flags = static_cast<int>(tile_object["component_flags"].get<double>());
                 picojson::array tile_components_array = tile_object["tile_components"].get<picojson::array>();
 
                 if (grid_x >= 0 && grid_x < result.entity_manager.map.dimensions.x &&
                     grid_y >= 0 && grid_y < result.entity_manager.map.dimensions.y)
                 {
                     ECS::Entity tile_entity;
-                    tile_entity.component_flags = component_flags;
+                    picojson::array tile_key;
                     for (picojson::value::array::const_iterator component_obj_it = tile_components_array.begin();
                          component_obj_it != tile_components_array.end();
                          ++component_obj_it)
@@ -250,13 +248,15 @@ Serialize::LoadMapResult Serialize::load_game(std::string file)
                         {
                             picojson::object component_object = component_obj_it->get<picojson::object>();
                             ECS::ComponentizeJsonResult cjr = ECS::componentize_json(&component_object);
-                            if (cjr.success)
+                            if (!cjr.success)
                             {
-                                tile_entity.add_component(&cjr.component);
+                                printf("JSON Load Err: componentize_json failed\n");
                             }
-                            else
+                            else if (cjr.component.type != ECS::POSITION)
                             {
-                                printf("JSON Load Err: componentize_json failed\n");
+                                // Positions come from the cell (older saves stored one per tile).
+                                tile_entity.add_component(&cjr.component);
+                                tile_key.push_back(picojson::value(ECS::jsonize_component(cjr.component.type, &cjr.component)));
                             }
                         }
                         else
@@ -264,12 +264,29 @@ Serialize::LoadMapResult Serialize::load_game(std::string file)
                             printf("JSON Load Err: Entity 'components' array contains non-object value\n");
                         }
                     }
-                    result.entity_manager.map.grid[grid_x][grid_y].tile.tile_entity = tile_entity;
-                    result.entity_manager.map.grid[grid_x][grid_y].tile.empty = false;
+                    std::string key = picojson::value(tile_key).serialize();
+                    if (tile_prototype_ids.find(key) == tile_prototype_ids.end())
+                    {
+                        // Prototypes outlive a load, so reuse one from the
+                        // things files or an earlier load when it matches.
+                        int existing_id = ECS::find_prototype(&tile_entity);
+                        tile_prototype_ids[key] = existing_id != -1 ? existing_id : ECS::register_prototype(&tile_entity);
+                    }
+                    int prototype_id = tile_prototype_ids[key];
+                    ECS::TileLayer layer = ECS::get_tile_layer(ECS::get_prototype(prototype_id));
+                    if (tile_object["layer"].is<double>())
+                    {
+                        int saved_layer = static_cast<int>(tile_object["layer"].get<double>());
+                        if (saved_layer >= 0 && saved_layer < ECS::NUM_TILE_LAYERS)
+                        {
+                            layer = static_cast<ECS::TileLayer>(saved_layer);
+                        }
+                    }
+                    result.entity_manager.map.grid.set_tile({grid_x, grid_y}, layer, prototype_id);
                     if (tile_object["entity_id"].is<double>())
                     {
-                        result.entity_manager.map.grid[grid_x][grid_y].has_entity = true;
-                        result.entity_manager.map.grid[grid_x][grid_y].entity_id = static_cast<int>(tile_object["entity_id"].get<double>());
+                        // Resolved to a handle once the entities are loaded.
+                        cell_entity_ids.push_back({{grid_x, grid_y}, static_cast<int>(tile_object["entity_id"].get<double>())});
                     }
                     // printf("Successfully loaded tile at: %d %d with texture key: %s and clip vals: %d %d %d %d\n",
                     //        grid_x, grid_y, texture_key.c_str(), clip_x, clip_y, clip_w, clip_h);
@@ -291,7 +308,7 @@ Serialize::LoadMapResult Serialize::load_game(std::string file)
     }
     // ******************************************
 
-    std::vector<ECS::Entity> entities_array_return(entities_array.size());
+    std::unordered_map<int, ECS::EntityHandle> saved_id_to_handle;
     // ************** ENTITIES ******************
     for (picojson::value::array::const_iterator obj_it = entities_array.begin(); obj_it != entities_array.end(); ++obj_it)
     {
@@ -323,7 +340,12 @@ Serialize::LoadMapResult Serialize::load_game(std::string file)
                 int id = static_cast<int>(entity_object["id"].get<double>());
                 int component_flags = static_cast<int>(entity_object["component_flags"].get<double>());
                 entity.component_flags = component_flags;
-                entities_array_return[id] = entity;
+                if (saved_id_to_handle.find(id) != saved_id_to_handle.end())
+                {
+                    printf("JSON Load Err: Duplicate entity id %d\n", id);
+                    continue;
+                }
+                saved_id_to_handle[id] = result.entity_manager.entities.create_entity(entity);
             }
             else
             {
@@ -335,7 +357,15 @@ Serialize::LoadMapResult Serialize::load_game(std::string file)
             printf("Load JSON Err: Entities should be an array of objects\n");
         }
     }
-    result.entity_manager.entities = entities_array_return;
+    for (std::pair<V2, int> &cell_entity_id : cell_entity_ids)
+    {
+        if (saved_id_to_handle.find(cell_entity_id.second) == saved_id_to_handle.end())
+        {
+            printf("JSON Load Err: Tile references missing entity id %d\n", cell_entity_id.second);
+            continue;
+        }
+        result.entity_manager.map.grid.set_entity(cell_entity_id.first, saved_id_to_handle[cell_entity_id.second]);
+    }
     // ******************************************
     result.success = true;
     return result;
@@ -397,6 +427,7 @@ void process_thing_file(std::string file, Serialize::LoadThingsResult *things)
                                 }
                                 buildable.build_category = build_category;
                                 process_json_component_array(&buildable.entity, &component_array);
+                                ECS::register_prototype(&buildable.entity);
                                 things->buildables.push_back(buildable);
                             }
                             else
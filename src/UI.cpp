@@ -36,50 +36,52 @@ void UI::Text::set_text(std::string text)
     if (text == "")
     {
         this->text = "";
+        this->layout = nullptr;
         this->dimensions = {};
         return;
     }
     if (this->text != text)
     {
-        assert(this->texture_key != "");
-        auto info = Assets::create_texture_from_text(
-            SDL::get_renderer(),
-            this->font_index,
-            this->texture_key,
-            text,
-            {0xFF, 0xFF, 0xFF, 0xFF});
+        this->layout = Glyphs::layout_text(this->font_index, text);
         this->text = text;
-        this->texture_index = info.texture_index;
-        this->dimensions = info.dimensions;
+        this->dimensions = this->layout != nullptr ? this->layout->dimensions : V2{};
     }
 }
 
 void UI::Text::update(double ts)
 {
-    if (this->text == "")
+    if (this->text == "" || this->layout == nullptr)
     {
         return;
     }
-    if (this->has_overflow_clip)
+    if (!Render::batches_geometry())
     {
-        Render::render_texture(
-            this->render_layer,
-            this->texture_index,
-            this->position,
-            &this->overflow_clip,
-            1,
-            z_index);
-    }
-    else
-    {
-        Render::render_texture(
-            this->render_layer,
-            this->texture_index,
-            this->position,
-            nullptr,
-            1,
-            z_index);
+        // Each glyph would be a draw call of its own, so draw the string as
+        // one texture instead.
+        if (this->texture_text != this->text)
+        {
+            assert(this->texture_key != "");
+            this->texture_index = Glyphs::bake_text(this->font_index, this->texture_key, *this->layout).texture_index;
+            this->texture_text = this->text;
+        }
+        if (this->texture_index != -1)
+        {
+            Render::render_texture(
+                this->render_layer,
+                this->texture_index,
+                this->position,
+                this->has_overflow_clip ? &this->overflow_clip : nullptr,
+                1,
+                z_index);
+        }
+        return;
     }
+    Glyphs::render_text(
+        this->render_layer,
+        *this->layout,
+        this->position,
+        this->has_overflow_clip ? &this->overflow_clip : nullptr,
+        z_index);
 }
 
 void UI::TextButton::update(double ts)
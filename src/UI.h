@@ -3,6 +3,7 @@
 
 #include "GameTypes.h"
 #include "Render.h"
+#include "Glyphs.h"
 #include <string>
 
 namespace UI
@@ -34,9 +35,13 @@ struct Text
     V2 position;
     Rect overflow_clip;
     int font_index;
-    int texture_index;
     std::string text;
+    std::shared_ptr<const Glyphs::Layout> layout;
+    // Only used when the renderer can't batch glyph quads: the string is
+    // baked into this texture and redrawn there whenever it changes.
     std::string texture_key;
+    std::string texture_text;
+    int texture_index;
     Render::Layer render_layer;
     int z_index;
     bool has_overflow_clip;
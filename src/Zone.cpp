@@ -25,22 +25,16 @@ void Zone::Manager::update(ECS::Map *map, double ts)
         Rect *camera = Window::get_camera();
         if (start_x >= 0 && end_x < map->dimensions.x && start_y >= 0 && end_y < map->dimensions.y)
         {
-            for (int i = start_x; i <= end_x; ++i)
-            {
-                for (int j = start_y; j <= end_y; ++j)
-                {
-                    if (!map->grid[i][j].tile.empty && !map->grid[i][j].has_entity)
-                    {
-                        Rect cell_to_render = {
-                            (static_cast<int>(i) * map->cell_size) - camera->x,
-                            (static_cast<int>(j) * map->cell_size) - camera->y,
-                            map->cell_size,
-                            map->cell_size};
-                        Color color = {0xFF, 0xFF, 0xFF, 0x6F};
-                        Render::render_rectangle(Render::Layer::WORLD_LAYER, cell_to_render, color, true, 2);
-                    }
-                }
-            }
+            Rect area = {start_x, start_y, end_x - start_x + 1, end_y - start_y + 1};
+            map->grid.each_free_cell(area, [&](V2 grid_position) {
+                Rect cell_to_render = {
+                    (grid_position.x * map->cell_size) - camera->x,
+                    (grid_position.y * map->cell_size) - camera->y,
+                    map->cell_size,
+                    map->cell_size};
+                Color color = {0xFF, 0xFF, 0xFF, 0x6F};
+                Render::render_rectangle(Render::Layer::WORLD_LAYER, cell_to_render, color, true, 2);
+            });
         }
     }
     else if (this->state == Zone::WAITING_TO_PLACE_ZONE)
@@ -10,6 +10,9 @@
 #include "Serialize.h"
 #include "Debug.h"
 #include "Physics.h"
+#include "Jobs.h"
+#include "Scheduler.h"
+#include "Path.h"
 #include <stdio.h>
 
 #ifdef _WIN32
@@ -47,6 +50,9 @@ int main(int argc, char *argv[])
     V2 dimensions = {100, 100};
     ProcGen::Return r = ProcGen::generate_map(&rules, &dimensions);
     Order::Manager order_manager = Order::Manager();
+    Path::Manager path_manager;
+    ECS::Scheduler scheduler;
+    ECS::add_core_systems(&scheduler);
     GUI::GUI gui;
     gui.build_menu.set_buildables(&load_things_result.buildables);
 
@@ -66,6 +72,7 @@ int main(int argc, char *argv[])
     while (Input::is_running())
     {
         Input::collect_input_events();
+        Jobs::pump_main_thread();
 
         // update
         gui.process_messages();
@@ -74,15 +81,18 @@ int main(int argc, char *argv[])
 
         r.entity_manager.process_messages();
         MBus::clear_ecs_messages();
-        r.entity_manager.update_player(context.time_step);
-        r.entity_manager.update(context.time_step);
+
+        path_manager.process_messages(&r.entity_manager.map);
+        MBus::clear_path_messages();
+        MBus::clear_path_replies();
+        path_manager.update(&r.entity_manager.map, context.time_step);
+
+        scheduler.run(&r.entity_manager, context.time_step);
 
         order_manager.process_messages(&r.entity_manager.map);
         MBus::clear_order_messages();
         order_manager.update(&r.entity_manager.map, context.time_step);
 
-        ECS::process_map(&r.entity_manager.map, context.time_step);
-
         debugger.process_messages();
         MBus::clear_debug_messages();
         debugger.update(context.time_step);
@@ -153,6 +163,7 @@ int main(int argc, char *argv[])
 
         last_counter = end_counter;
     }
+    Jobs::shutdown();
     return 0;
 }
 
@@ -204,6 +215,7 @@ EngineContext engine_init()
     Window::set_camera({0, 0, 800, 640});
     Window::set_gui_camera({0, 0, 800, 640});
     Input::init({800, 640});
+    Jobs::init();
     return context;
 };
 